@@ -0,0 +1,13 @@
+// Screen quad for deferred voxel cone tracing. The surface is read from the G-buffer (see voxel_cone_tracing.frag).
+#version 450 core
+
+layout(location = 0) in vec3 position;
+
+out vec3 worldPositionFrag; // Unused, since the G-buffer is shaded.
+out vec3 normalFrag;
+
+void main(){
+	worldPositionFrag = vec3(0);
+	normalFrag = vec3(0, 0, 1);
+	gl_Position = vec4(position.xy, 0, 1);
+}
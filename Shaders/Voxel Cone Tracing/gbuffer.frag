@@ -0,0 +1,47 @@
+// Writes the surface of every pixel to the G-buffer, which is then shaded once per pixel by voxel_cone_tracing.frag.
+// The layout has to match readGBuffer in voxel_cone_tracing.frag.
+#version 450 core
+
+#ifndef MULTI_DRAW
+#define MULTI_DRAW 0 /* Defined by Graphics (see Graphics::multiDrawIndirect). */
+#endif
+
+struct Material {
+	vec3 diffuseColor;
+	float diffuseReflectivity;
+	vec3 specularColor;
+	float specularDiffusion;
+	float specularReflectivity;
+	float emissivity;
+	float refractiveIndex;
+	float transparency;
+};
+
+#if (MULTI_DRAW == 1)
+// The material settings of all renderers, indexed by the draw (see Graphics::uploadUniformBuffers).
+layout(std430, binding = 6) readonly buffer MaterialSettings { Material materials[]; };
+flat in uint materialIndexFrag;
+#define material materials[materialIndexFrag]
+#else
+// The material setting of the renderer being drawn (see Graphics::MaterialBlock).
+layout(std140, binding = 2) uniform MaterialSettings {
+	Material material;
+};
+#endif
+
+in vec3 worldPositionFrag;
+in vec3 normalFrag;
+
+layout(location = 0) out vec4 position; // World position (xyz), and 1 where there is geometry (w).
+layout(location = 1) out vec4 normal; // Normal (xyz) and specular diffusion (w).
+layout(location = 2) out vec4 diffuse; // Diffuse color (rgb) and diffuse reflectivity (a).
+layout(location = 3) out vec4 specular; // Specular color (rgb) and specular reflectivity (a).
+layout(location = 4) out vec4 other; // Emissivity (r), refractive index (g) and transparency (b).
+
+void main(){
+	position = vec4(worldPositionFrag, 1);
+	normal = vec4(normalize(normalFrag), material.specularDiffusion);
+	diffuse = vec4(material.diffuseColor, material.diffuseReflectivity);
+	specular = vec4(material.specularColor, material.specularReflectivity);
+	other = vec4(material.emissivity, material.refractiveIndex, material.transparency, 0);
+}
@@ -17,21 +17,64 @@
 #define TSQRT2 2.828427
 #define SQRT2 1.414213
 #define ISQRT2 0.707106
+#define SQRT3 1.732051
+// --------------------------------------
+// Permutation settings. Defined by Graphics (see Graphics::getVoxelConeTracingMaterial).
+// Disabled features are compiled out. The defaults below are only used if a setting isn't defined.
+// --------------------------------------
+#ifndef SHADOWS
+#define SHADOWS 1 /* Shadow cone tracing. */
+#endif
+#ifndef DIRECT_LIGHT
+#define DIRECT_LIGHT 1 /* Whether direct light should be rendered or not. */
+#endif
+#ifndef INDIRECT_DIFFUSE_LIGHT
+#define INDIRECT_DIFFUSE_LIGHT 1 /* Whether indirect diffuse light should be rendered or not. */
+#endif
+#ifndef INDIRECT_SPECULAR_LIGHT
+#define INDIRECT_SPECULAR_LIGHT 1 /* Whether indirect specular light should be rendered or not. */
+#endif
+#ifndef SPECULAR_MODE
+#define SPECULAR_MODE 1 /* 0 == Blinn-Phong (halfway vector), 1 == reflection model. */
+#endif
+#ifndef MAX_LIGHTS
+#define MAX_LIGHTS 1 /* Maximum number of lights supported. */
+#endif
+#ifndef GAMMA_CORRECTION
+#define GAMMA_CORRECTION 1 /* Whether to use gamma correction or not. */
+#endif
+#ifndef VOXEL_STORAGE
+#define VOXEL_STORAGE 0 /* How the voxelized scene is stored (see Graphics::VoxelStorage). */
+#endif
+#ifndef ANISOTROPIC_VOXELS
+#define ANISOTROPIC_VOXELS 0 /* Whether mipmap levels >= 1 of the voxel texture are stored as six directional volumes. */
+#endif
+#ifndef DEFERRED
+#define DEFERRED 0 /* Whether to shade the G-buffer (using a screen quad) instead of the rasterized fragments. */
+#endif
+#ifndef MULTI_DRAW
+#define MULTI_DRAW 0 /* Whether the scene is drawn using a multi-draw (see Graphics::multiDrawIndirect). */
+#endif
+#ifndef INDIRECT_DIFFUSE_MODE
+#define INDIRECT_DIFFUSE_MODE 0 /* How this pass handles indirect diffuse light (see the indirect diffuse modes below). */
+#endif
 // --------------------------------------
 // Light (voxel) cone tracing settings.
 // --------------------------------------
 #define MIPMAP_HARDCAP 5.4f /* Too high mipmap levels => glitchiness, too low mipmap levels => sharpness. */
-#define VOXEL_SIZE (1/64.0) /* Size of a voxel. 128x128x128 => 1/128 = 0.0078125. */
-#define SHADOWS 1 /* Shadow cone tracing. */
-#define DIFFUSE_INDIRECT_FACTOR 0.52f /* Just changes intensity of diffuse indirect lighting. */
+#define DIFFUSE_INDIRECT_FACTOR 4.68f /* Just changes intensity of diffuse indirect lighting. */
+#ifndef DIFFUSE_CONES
+#define DIFFUSE_CONES 9 /* Number of indirect diffuse cones: 1, 5, 6, 9 or 16 (see Graphics::diffuseCones). */
+#endif
+#define DIFFUSE_CONE_SPREAD (0.325f * sqrt(9.0f / DIFFUSE_CONES)) /* Fewer cones are wider, i.e. all sets cover the same solid angle. */
+#define DIFFUSE_CONE_APERTURE (0.516f * sqrt(9.0f / DIFFUSE_CONES)) /* tan(half angle) of the cones with anisotropic voxels. 9 cones of this angle cover the hemisphere's solid angle. */
+#define ANISOTROPIC_DIFFUSE_FACTOR 0.13f /* Matches the brightness of front-to-back compositing to the isotropic cones. */
 // --------------------------------------
 // Other lighting settings.
 // --------------------------------------
-#define SPECULAR_MODE 1 /* 0 == Blinn-Phong (halfway vector), 1 == reflection model. */
 #define SPECULAR_FACTOR 4.0f /* Specular intensity tweaking factor. */
 #define SPECULAR_POWER 65.0f /* Specular power in Blinn-Phong. */
 #define DIRECT_LIGHT_INTENSITY 0.96f /* (direct) point light intensity factor. */
-#define MAX_LIGHTS 1 /* Maximum number of lights supported. */
 
 // Lighting attenuation factors. See the function "attenuate" (below) for more information.
 #define DIST_FACTOR 1.1f /* Distance is multiplied by this when calculating attenuation. */
@@ -39,8 +82,31 @@
 #define LINEAR 0 /* Looks meh when using gamma correction. */
 #define QUADRATIC 1
 
-// Other settings.
-#define GAMMA_CORRECTION 1 /* Whether to use gamma correction or not. */
+// Voxel storage (see Graphics::VoxelStorage).
+#define DENSE_TEXTURE 0
+#define SPARSE_VOXEL_OCTREE 1
+#define CLIPMAP 2
+#define MAX_CLIPMAP_CASCADES 6
+
+// Indirect diffuse modes (see Graphics::IndirectDiffuseMode).
+#define TRACE_PER_FRAGMENT 0 /* Traces indirect diffuse cones for every fragment. */
+#define TRACE_DOWNSAMPLED 1 /* Only traces indirect diffuse cones, into the downsampled buffer. */
+#define UPSAMPLE 2 /* Upsamples indirect diffuse light from the downsampled buffer. */
+#define TRACE_TEMPORAL 3 /* Like TRACE_DOWNSAMPLED, but traces a subset of the cones and accumulates it with the history. */
+#define DEPTH_TOLERANCE 0.1f /* Relative depth difference at which a downsampled texel has 1/e of its weight. */
+#define NORMAL_POWER 8 /* Sharpness of the normal weight of downsampled texels. */
+#define MIN_MATCH 0.1f /* Fragments that match no downsampled texel better than this trace their own cones. */
+#define HISTORY_MATCH 0.5f /* Reprojected history texels that match worse than this are disocclusions. */
+#define CONE_SUBSETS (DIFFUSE_CONES < 3 ? DIFFUSE_CONES : 3) /* The diffuse cones are traced over this many frames when temporal. */
+#define MAX_HISTORY 12 /* The number of frames that indirect diffuse light is accumulated over. A multiple of CONE_SUBSETS. */
+
+// Per-frame data, shared by all programs (see Graphics::FrameBlock).
+layout(std140, binding = 0) uniform Frame {
+	mat4 V;
+	mat4 P;
+	vec3 cameraPosition; // World camera position.
+	int state; // Only used for testing / debugging.
+};
 
 // Basic point light.
 struct PointLight {
@@ -48,40 +114,74 @@ struct PointLight {
 	vec3 color;
 };
 
+// The lights of the scene (see Graphics::PointLightBlock).
+layout(std140, binding = 1) uniform Lights {
+	int numberOfLights; // Number of lights currently uploaded.
+	PointLight pointLights[MAX_LIGHTS];
+};
+
 // Basic material.
 struct Material {
 	vec3 diffuseColor;
 	float diffuseReflectivity;
 	vec3 specularColor;
-	float specularDiffusion; // "Reflective and refractive" specular diffusion. 
+	float specularDiffusion; // "Reflective and refractive" specular diffusion.
 	float specularReflectivity;
 	float emissivity; // Emissive materials uses diffuse color as emissive color.
 	float refractiveIndex;
 	float transparency;
 };
 
-struct Settings {
-	bool indirectSpecularLight; // Whether indirect specular light should be rendered or not.
-	bool indirectDiffuseLight; // Whether indirect diffuse light should be rendered or not.
-	bool directLight; // Whether direct light should be rendered or not.
-	bool shadows; // Whether shadows should be rendered or not.
+#if (MULTI_DRAW == 1)
+// The material settings of all renderers, indexed by the draw (see Graphics::uploadUniformBuffers).
+layout(std430, binding = 6) readonly buffer MaterialSettings { Material materials[]; };
+flat in uint materialIndexFrag;
+#define material materials[materialIndexFrag]
+#else
+// The material setting of the renderer being drawn (see Graphics::MaterialBlock).
+layout(std140, binding = 2) uniform MaterialSettings {
+	Material material;
 };
+#endif
 
-uniform Material material;
-uniform Settings settings;
-uniform PointLight pointLights[MAX_LIGHTS];
-uniform int numberOfLights; // Number of lights currently uploaded.
-uniform vec3 cameraPosition; // World campera position.
-uniform int state; // Only used for testing / debugging.
 uniform sampler3D texture3D; // Voxelization texture.
+uniform float voxelSize; // Size of a voxel. 128x128x128 => 1/128 = 0.0078125.
+uniform int octreeLevels; // Number of levels in the sparse voxel octree, i.e. log2 of its resolution.
+uniform int clipmapCascades; // Number of clipmap cascades currently uploaded.
+uniform vec4 clipmapRegions[MAX_CLIPMAP_CASCADES]; // World space center (xyz) and half extent (w) of every cascade.
+uniform sampler3D clipmap[MAX_CLIPMAP_CASCADES]; // Clipmap cascades. Addressed toroidally (i.e. wrapped around the world origin).
+uniform sampler3D texture3DAnisotropic[6]; // Directional volumes (+x, -x, +y, -y, +z, -z). Level 0 is level 1 of texture3D.
+uniform vec2 screenSize; // Size of the viewport in pixels.
+uniform sampler2D indirectDiffuseBuffer; // Downsampled indirect diffuse irradiance (rgb), i.e. without the material. The previous frame's if temporal.
+uniform sampler2D indirectDiffuseGeometry; // Normal (xyz) and distance to the camera (w) of every texel of the buffer.
+uniform bool temporalHistory; // Whether the buffer holds the previous frame when temporal.
+uniform int temporalFrame; // Selects the subset of diffuse cones that is traced when temporal.
+uniform mat4 previousViewProjection; // The camera of the previous frame.
+uniform vec3 previousCameraPosition;
+
+// G-buffer (see gbuffer.frag). Read using image loads, since it's never filtered and the texture units are taken.
+layout(rgba32f) readonly uniform image2D gBufferPosition; // World position (xyz), and 1 where there is geometry (w).
+layout(rgba16f) readonly uniform image2D gBufferNormal; // Normal (xyz) and specular diffusion (w).
+layout(rgba16f) readonly uniform image2D gBufferDiffuse; // Diffuse color (rgb) and diffuse reflectivity (a).
+layout(rgba16f) readonly uniform image2D gBufferSpecular; // Specular color (rgb) and specular reflectivity (a).
+layout(rgba16f) readonly uniform image2D gBufferMaterial; // Emissivity (r), refractive index (g) and transparency (b).
+
+// Sparse voxel octree node and brick pools (see SparseVoxelOctree.h).
+layout(std430, binding = 1) readonly buffer OctreeNodes { uint octreeNodes[]; };
+layout(std430, binding = 2) readonly buffer OctreeBricks { uint octreeBricks[]; };
 
 in vec3 worldPositionFrag;
 in vec3 normalFrag;
 
-out vec4 color;
+layout(location = 0) out vec4 color;
+layout(location = 1) out vec4 geometry; // Only written when tracing into the downsampled buffer.
 
-vec3 normal = normalize(normalFrag); 
-float MAX_DISTANCE = distance(vec3(abs(worldPositionFrag)), vec3(-1));
+// The surface that is shaded. Given by the rasterized fragment and the material, or by the G-buffer if deferred.
+vec3 worldPosition;
+vec3 normal;
+Material surface;
+float MAX_DISTANCE;
+float MAX_DIFFUSE_DISTANCE; // Diffuse cones end at SQRT2 times the half extent of the voxel grid (i.e. of the largest cascade).
 
 // Returns an attenuation factor given a distance.
 float attenuate(float dist){ dist *= DIST_FACTOR; return 1.0f / (CONSTANT + LINEAR * dist + QUADRATIC * dist * dist); }
@@ -99,6 +199,106 @@ vec3 scaleAndBias(const vec3 p) { return 0.5f * p + vec3(0.5f); }
 // Returns true if the point p is inside the unity cube. 
 bool isInsideCube(const vec3 p, float e) { return abs(p.x) < 1 + e && abs(p.y) < 1 + e && abs(p.z) < 1 + e; }
 
+// Returns true if p is inside the voxelized part of the world, i.e. the unity cube or the largest clipmap cascade.
+bool isInsideVoxelGrid(const vec3 p){
+#if (VOXEL_STORAGE == CLIPMAP)
+	const vec4 region = clipmapRegions[clipmapCascades - 1];
+	return all(lessThan(abs(p - region.xyz), vec3(region.w)));
+#else
+	return isInsideCube(p, 0);
+#endif
+}
+
+// Returns the voxel at an integer position on a given level of the sparse voxel octree.
+// The top level (a single voxel) is the average of the root tile's brick.
+vec4 fetchOctree(const ivec3 voxel, const int level){
+	if(any(lessThan(voxel, ivec3(0))) || any(greaterThanEqual(voxel, ivec3(1 << (octreeLevels - level))))) return vec4(0);
+	if(level == octreeLevels){
+		vec4 acc = vec4(0);
+		for(int i = 0; i < 8; ++i) acc += unpackUnorm4x8(octreeBricks[i]);
+		return acc / 8;
+	}
+	uint tile = 0;
+	for(int l = octreeLevels - 1; l > level; --l){
+		const ivec3 octant = (voxel >> (l - level)) & 1;
+		tile = octreeNodes[8 * tile + octant.x + 2 * octant.y + 4 * octant.z];
+		if(tile == 0) return vec4(0);
+	}
+	const ivec3 octant = voxel & 1;
+	return unpackUnorm4x8(octreeBricks[8 * tile + octant.x + 2 * octant.y + 4 * octant.z]);
+}
+
+// Samples a level of the sparse voxel octree using trilinear filtering.
+vec4 sampleOctreeLevel(const vec3 p, const int level){
+	const vec3 q = p * float(1 << (octreeLevels - level)) - 0.5f;
+	const vec3 base = floor(q);
+	const vec3 t = q - base;
+	vec4 acc = vec4(0);
+	for(int i = 0; i < 8; ++i){
+		const ivec3 corner = ivec3(i, i >> 1, i >> 2) & 1;
+		const vec3 w = mix(1 - t, t, vec3(corner));
+		acc += w.x * w.y * w.z * fetchOctree(ivec3(base) + corner, level);
+	}
+	return acc;
+}
+
+// Samples a clipmap cascade at the world position p.
+// Sampler arrays may only be indexed by constants here, since the cascade varies per fragment.
+vec4 sampleCascade(const int cascade, const vec3 p, const float level){
+	const vec3 t = p / (2 * clipmapRegions[cascade].w);
+	switch(cascade){
+	case 0: return textureLod(clipmap[0], t, level);
+	case 1: return textureLod(clipmap[1], t, level);
+	case 2: return textureLod(clipmap[2], t, level);
+	case 3: return textureLod(clipmap[3], t, level);
+	case 4: return textureLod(clipmap[4], t, level);
+	default: return textureLod(clipmap[5], t, level);
+	}
+}
+
+// Samples the clipmap at the world position p. Every cascade has twice the voxel size of the previous one, so the
+// integer part of the level selects the cascade, unless p is outside of it (then a larger cascade is used).
+vec4 sampleClipmap(const vec3 p, const float level){
+	int cascade = clamp(int(level), 0, clipmapCascades - 1);
+	for(; cascade < clipmapCascades - 1; ++cascade){
+		const vec4 region = clipmapRegions[cascade];
+		const float margin = 2 * region.w / textureSize(clipmap[0], 0).x; // One voxel (for filtering).
+		if(all(lessThan(abs(p - region.xyz), vec3(region.w - margin)))) break;
+	}
+	return sampleCascade(cascade, p, max(level - cascade, 0));
+}
+
+// Samples the anisotropic voxel texture as seen by a cone that travels in the given direction.
+// The three volumes that face the cone are weighted by the squared direction (see anisotropic_mipmap.comp).
+vec4 sampleAnisotropic(const vec3 p, const float level, const vec3 direction){
+	const vec3 t = scaleAndBias(p);
+	const float l = max(level - 1, 0);
+	const vec3 w = direction * direction / dot(direction, direction);
+	const vec4 x = direction.x > 0 ? textureLod(texture3DAnisotropic[0], t, l) : textureLod(texture3DAnisotropic[1], t, l);
+	const vec4 y = direction.y > 0 ? textureLod(texture3DAnisotropic[2], t, l) : textureLod(texture3DAnisotropic[3], t, l);
+	const vec4 z = direction.z > 0 ? textureLod(texture3DAnisotropic[4], t, l) : textureLod(texture3DAnisotropic[5], t, l);
+	const vec4 voxel = w.x * x + w.y * y + w.z * z;
+	return level < 1 ? mix(textureLod(texture3D, t, 0), voxel, max(level, 0)) : voxel;
+}
+
+// Samples the voxelized scene at the world position p using quadrilinear filtering.
+// The level is given in mipmap levels of a voxel grid with voxels of size voxelSize.
+// The direction is the direction of the cone that samples the scene.
+vec4 sampleVoxels(const vec3 p, const float level, const vec3 direction){
+#if (VOXEL_STORAGE == CLIPMAP)
+	return sampleClipmap(p, level);
+#elif (VOXEL_STORAGE == DENSE_TEXTURE && ANISOTROPIC_VOXELS == 1)
+	return sampleAnisotropic(p, level, direction);
+#elif (VOXEL_STORAGE == DENSE_TEXTURE)
+	return textureLod(texture3D, scaleAndBias(p), level);
+#else
+	const float l = clamp(level + octreeLevels + log2(voxelSize), 0, octreeLevels);
+	const int lower = int(l);
+	const vec4 voxel = sampleOctreeLevel(scaleAndBias(p), lower);
+	return l > lower ? mix(voxel, sampleOctreeLevel(scaleAndBias(p), lower + 1), l - lower) : voxel;
+#endif
+}
+
 // Returns a soft shadow blend by using shadow cone tracing.
 // Uses 2 samples per step, so it's pretty expensive.
 float traceShadowCone(vec3 from, vec3 direction, float targetDistance){
@@ -106,57 +306,97 @@ float traceShadowCone(vec3 from, vec3 direction, float targetDistance){
 
 	float acc = 0;
 
-	float dist = 3 * VOXEL_SIZE;
+	float dist = 3 * voxelSize;
 	// I'm using a pretty big margin here since I use an emissive light ball with a pretty big radius in my demo scenes.
-	const float STOP = targetDistance - 16 * VOXEL_SIZE;
+	const float STOP = targetDistance - 16 * voxelSize;
 
 	while(dist < STOP && acc < 1){	
 		vec3 c = from + dist * direction;
-		if(!isInsideCube(c, 0)) break;
-		c = scaleAndBias(c);
+		if(!isInsideVoxelGrid(c)) break;
 		float l = pow(dist, 2); // Experimenting with inverse square falloff for shadows.
-		float s1 = 0.062 * textureLod(texture3D, c, 1 + 0.75 * l).a;
-		float s2 = 0.135 * textureLod(texture3D, c, 4.5 * l).a;
+		float s1 = 0.062 * sampleVoxels(c, 1 + 0.75 * l, direction).a;
+		float s2 = 0.135 * sampleVoxels(c, 4.5 * l, direction).a;
 		float s = s1 + s2;
 		acc += (1 - acc) * s;
-		dist += 0.9 * VOXEL_SIZE * (1 + 0.05 * l);
+		dist += 0.9 * voxelSize * (1 + 0.05 * l);
 	}
 	return 1 - pow(smoothstep(0, 1, acc * 1.4), 1.0 / 1.4);
 }	
 
+// Indirect diffuse cone sets, in tangent space (the normal is z). The directions are normalized when traced.
+// Ring cones are listed in azimuth order, so that every temporal subset (every CONE_SUBSETS:th cone) spreads around the normal.
+#if DIFFUSE_CONES == 1
+const vec3 DIFFUSE_CONE_DIRECTIONS[1] = { vec3(0, 0, 1) };
+#elif DIFFUSE_CONES == 5
+const vec3 DIFFUSE_CONE_DIRECTIONS[5] = { vec3(0, 0, 1), vec3(1, 0, 1), vec3(0, 1, 1), vec3(-1, 0, 1), vec3(0, -1, 1) };
+#elif DIFFUSE_CONES == 6
+const vec3 DIFFUSE_CONE_DIRECTIONS[6] = {
+	vec3(0, 0, 1), vec3(0.866, 0, 0.5), vec3(0.2676, 0.8236, 0.5), vec3(-0.7006, 0.509, 0.5), vec3(-0.7006, -0.509, 0.5), vec3(0.2676, -0.8236, 0.5)
+};
+#elif DIFFUSE_CONES == 9
+const vec3 DIFFUSE_CONE_DIRECTIONS[9] = {
+	vec3(0, 0, 1), vec3(0.5, 0, 0.5), vec3(0.25, 0.25, 0.5), vec3(0, 0.5, 0.5), vec3(-0.25, 0.25, 0.5),
+	vec3(-0.5, 0, 0.5), vec3(-0.25, -0.25, 0.5), vec3(0, -0.5, 0.5), vec3(0.25, -0.25, 0.5)
+};
+#elif DIFFUSE_CONES == 16
+const vec3 DIFFUSE_CONE_DIRECTIONS[16] = {
+	vec3(0, 0, 1), vec3(0.5, 0, 0.866), vec3(0.1545, 0.4755, 0.866), vec3(-0.4045, 0.2939, 0.866), vec3(-0.4045, -0.2939, 0.866),
+	vec3(0.1545, -0.4755, 0.866), vec3(0.8236, 0.2676, 0.5), vec3(0.509, 0.7006, 0.5), vec3(0, 0.866, 0.5), vec3(-0.509, 0.7006, 0.5),
+	vec3(-0.8236, 0.2676, 0.5), vec3(-0.8236, -0.2676, 0.5), vec3(-0.509, -0.7006, 0.5), vec3(0, -0.866, 0.5), vec3(0.509, -0.7006, 0.5),
+	vec3(0.8236, -0.2676, 0.5)
+};
+#else
+#error "DIFFUSE_CONES must be 1, 5, 6, 9 or 16."
+#endif
+
 // Traces a diffuse voxel cone.
 vec3 traceDiffuseVoxelCone(const vec3 from, vec3 direction){
 	direction = normalize(direction);
 	
-	const float CONE_SPREAD = 0.325;
+	const float CONE_SPREAD = DIFFUSE_CONE_SPREAD;
 
 	vec4 acc = vec4(0.0f);
 
-	// Controls bleeding from close surfaces.
+	// Controls bleeding from close surfaces. Given in voxels, i.e. 0.1953125 for a 64x64x64 grid.
 	// Low values look rather bad if using shadow cone tracing.
 	// Might be a better choice to use shadow maps and lower this value.
-	float dist = 0.1953125;
-
+	float dist = 12.5 * voxelSize;
+
+#if (VOXEL_STORAGE == DENSE_TEXTURE && ANISOTROPIC_VOXELS == 1)
+	// The directional volumes are composited along the direction of the cone, so they don't leak light through thin
+	// geometry. The cone is marched in steps of its own diameter: every sample covers the cone up to the next one, at the
+	// level whose voxels have that diameter, and the samples are composited front-to-back.
+	while(dist < MAX_DIFFUSE_DISTANCE && acc.a < 1){
+		const float diameter = max(2 * voxelSize, 2 * DIFFUSE_CONE_APERTURE * dist);
+		const vec4 voxel = sampleVoxels(from + dist * direction, min(MIPMAP_HARDCAP, log2(diameter / (2 * voxelSize))), direction);
+		acc += (1 - acc.a) * voxel;
+		dist += diameter;
+	}
+	return ANISOTROPIC_DIFFUSE_FACTOR * acc.rgb;
+#else
 	// Trace.
-	while(dist < SQRT2 && acc.a < 1){
+	while(dist < MAX_DIFFUSE_DISTANCE && acc.a < 1){
 		vec3 c = from + dist * direction;
-		c = scaleAndBias(from + dist * direction);
-		float l = (1 + CONE_SPREAD * dist / VOXEL_SIZE);
+#if (VOXEL_STORAGE == CLIPMAP)
+		if(!isInsideVoxelGrid(c)) break; // The cascades wrap around, i.e. they have no transparent border to fade into.
+#endif
+		float l = (1 + CONE_SPREAD * dist / voxelSize);
 		float level = log2(l);
 		float ll = (level + 1) * (level + 1);
-		vec4 voxel = textureLod(texture3D, c, min(MIPMAP_HARDCAP, level));
+		vec4 voxel = sampleVoxels(c, min(MIPMAP_HARDCAP, level), direction);
 		acc += 0.075 * ll * voxel * pow(1 - voxel.a, 2);
-		dist += ll * VOXEL_SIZE * 2;
+		dist += ll * voxelSize * 2;
 	}
 	return pow(acc.rgb * 2.0, vec3(1.5));
+#endif
 }
 
 // Traces a specular voxel cone.
 vec3 traceSpecularVoxelCone(vec3 from, vec3 direction){
 	direction = normalize(direction);
 
-	const float OFFSET = 8 * VOXEL_SIZE;
-	const float STEP = VOXEL_SIZE;
+	const float OFFSET = 8 * voxelSize;
+	const float STEP = voxelSize;
 
 	from += OFFSET * normal;
 	
@@ -166,93 +406,137 @@ vec3 traceSpecularVoxelCone(vec3 from, vec3 direction){
 	// Trace.
 	while(dist < MAX_DISTANCE && acc.a < 1){ 
 		vec3 c = from + dist * direction;
-		if(!isInsideCube(c, 0)) break;
-		c = scaleAndBias(c); 
+		if(!isInsideVoxelGrid(c)) break;
 		
-		float level = 0.1 * material.specularDiffusion * log2(1 + dist / VOXEL_SIZE);
-		vec4 voxel = textureLod(texture3D, c, min(level, MIPMAP_HARDCAP));
+		float level = 0.1 * surface.specularDiffusion * log2(1 + dist / voxelSize);
+		vec4 voxel = sampleVoxels(c, min(level, MIPMAP_HARDCAP), direction);
 		float f = 1 - acc.a;
-		acc.rgb += 0.25 * (1 + material.specularDiffusion) * voxel.rgb * voxel.a * f;
+		acc.rgb += 0.25 * (1 + surface.specularDiffusion) * voxel.rgb * voxel.a * f;
 		acc.a += 0.25 * voxel.a * f;
 		dist += STEP * (1.0f + 0.125f * level);
 	}
-	return 1.0 * pow(material.specularDiffusion + 1, 0.8) * acc.rgb;
+	return 1.0 * pow(surface.specularDiffusion + 1, 0.8) * acc.rgb;
 }
 
-// Calculates indirect diffuse light using voxel cone tracing.
-// The current implementation uses 9 cones. I think 5 cones should be enough, but it might generate
-// more aliasing and bad blur.
-vec3 indirectDiffuseLight(){
-	const float ANGLE_MIX = 0.5f; // Angle mix (1.0f => orthogonal direction, 0.0f => direction of normal).
-
-	const float w[3] = {1.0, 1.0, 1.0}; // Cone weights.
-
-	// Find a base for the side cones with the normal as one of its base vectors.
+// Calculates indirect diffuse irradiance using voxel cone tracing, with the cone set given by DIFFUSE_CONES.
+// The cones have the same aperture, so they're weighted by the cosine of their angle to the normal (Lambert).
+// Only the cones i with i % CONE_SUBSETS == subset are traced, unless subset is negative. The result is
+// always normalized by the weight of all cones, i.e. the subsets sum up to the full trace.
+vec3 traceIndirectDiffuse(const int subset){
+	// Find a base with the normal as one of its base vectors.
 	const vec3 ortho = normalize(orthogonal(normal));
 	const vec3 ortho2 = normalize(cross(ortho, normal));
-
-	// Find base vectors for the corner cones too.
-	const vec3 corner = 0.5f * (ortho + ortho2);
-	const vec3 corner2 = 0.5f * (ortho - ortho2);
+	const mat3 tangentToWorld = mat3(ortho, ortho2, normal);
 
 	// Find start position of trace (start with a bit of offset).
-	const vec3 N_OFFSET = normal * (1 + 4 * ISQRT2) * VOXEL_SIZE;
-	const vec3 C_ORIGIN = worldPositionFrag + N_OFFSET;
+	const vec3 N_OFFSET = normal * (1 + 4 * ISQRT2) * voxelSize;
+	const vec3 C_ORIGIN = worldPosition + N_OFFSET;
 
 	// Accumulate indirect diffuse light.
 	vec3 acc = vec3(0);
+	float weights = 0;
 
 	// We offset forward in normal direction, and backward in cone direction.
 	// Backward in cone direction improves GI, and forward direction removes
 	// artifacts.
 	const float CONE_OFFSET = -0.01;
 
-	// Trace front cone
-	acc += w[0] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * normal, normal);
+	for(int i = 0; i < DIFFUSE_CONES; ++i){
+		const float w = normalize(DIFFUSE_CONE_DIRECTIONS[i]).z;
+		weights += w;
+		if(subset >= 0 && i % CONE_SUBSETS != subset) continue;
+		const vec3 direction = tangentToWorld * normalize(DIFFUSE_CONE_DIRECTIONS[i]);
+		acc += w * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * direction, direction);
+	}
 
-	// Trace 4 side cones.
-	const vec3 s1 = mix(normal, ortho, ANGLE_MIX);
-	const vec3 s2 = mix(normal, -ortho, ANGLE_MIX);
-	const vec3 s3 = mix(normal, ortho2, ANGLE_MIX);
-	const vec3 s4 = mix(normal, -ortho2, ANGLE_MIX);
+	// Return result.
+	return DIFFUSE_INDIRECT_FACTOR * acc / weights;
+}
 
-	acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * ortho, s1);
-	acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * ortho, s2);
-	acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * ortho2, s3);
-	acc += w[1] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * ortho2, s4);
+// Returns how well a texel of the downsampled buffer (i.e. its normal and depth) matches the surface, in [0, 1].
+float matchGeometry(const vec4 g, const float depth){
+	return pow(max(dot(g.xyz, normal), 0), NORMAL_POWER) * exp(-abs(g.w - depth) / (DEPTH_TOLERANCE * depth));
+}
 
-	// Trace 4 corner cones.
-	const vec3 c1 = mix(normal, corner, ANGLE_MIX);
-	const vec3 c2 = mix(normal, -corner, ANGLE_MIX);
-	const vec3 c3 = mix(normal, corner2, ANGLE_MIX);
-	const vec3 c4 = mix(normal, -corner2, ANGLE_MIX);
+// Traces a subset of the diffuse cones and accumulates it with the previous frame's buffer, which is reprojected using
+// the previous camera. Returns the irradiance (rgb) and the number of frames accumulated (a). Texels that weren't visible
+// in the previous frame trace all cones, which counts as CONE_SUBSETS frames.
+vec4 accumulateIndirectDiffuse(){
+	vec4 history = vec4(0);
+	const vec4 p = previousViewProjection * vec4(worldPosition, 1);
+	const vec2 uv = 0.5f * p.xy / p.w + 0.5f;
+	if(temporalHistory && p.w > 0 && all(greaterThanEqual(uv, vec2(0))) && all(lessThan(uv, vec2(1)))){
+		const ivec2 texel = ivec2(uv * textureSize(indirectDiffuseBuffer, 0));
+		const vec4 g = texelFetch(indirectDiffuseGeometry, texel, 0);
+		if(matchGeometry(g, distance(worldPosition, previousCameraPosition)) >= HISTORY_MATCH)
+			history = texelFetch(indirectDiffuseBuffer, texel, 0);
+	}
+	if(history.a == 0) return vec4(traceIndirectDiffuse(-1), CONE_SUBSETS);
+
+	// A running average of the subsets (scaled to all cones). The history is only capped when a cycle of subsets starts,
+	// so that every subset has the same weight once the cycle is complete, i.e. it converges to the full trace.
+	const int subset = temporalFrame % CONE_SUBSETS;
+	const vec3 estimate = CONE_SUBSETS * traceIndirectDiffuse(subset);
+	const float frames = (subset == 0 ? min(history.a, MAX_HISTORY - CONE_SUBSETS) : history.a) + 1;
+	return vec4(mix(history.rgb, estimate, 1.0f / frames), frames);
+}
 
-	acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * corner, c1);
-	acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * corner, c2);
-	acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN + CONE_OFFSET * corner2, c3);
-	acc += w[2] * traceDiffuseVoxelCone(C_ORIGIN - CONE_OFFSET * corner2, c4);
+// Upsamples indirect diffuse irradiance from the downsampled buffer using a joint bilateral filter, i.e. the 4 closest
+// texels are weighted bilinearly and by how well their depth and normal match the fragment's.
+vec3 upsampleIndirectDiffuse(){
+	const ivec2 size = textureSize(indirectDiffuseBuffer, 0);
+	const vec2 p = gl_FragCoord.xy * vec2(size) / screenSize - 0.5f;
+	const ivec2 base = ivec2(floor(p));
+	const vec2 t = p - base;
+	const float depth = distance(worldPosition, cameraPosition);
 
-	// Return result.
-	return DIFFUSE_INDIRECT_FACTOR * material.diffuseReflectivity * acc * (material.diffuseColor + vec3(0.001f));
+	vec3 acc = vec3(0);
+	float weights = 0, bestMatch = 0;
+	for(int i = 0; i < 4; ++i){
+		const ivec2 corner = ivec2(i & 1, i >> 1);
+		const ivec2 texel = clamp(base + corner, ivec2(0), size - 1);
+		const vec4 g = texelFetch(indirectDiffuseGeometry, texel, 0);
+		const vec2 b = mix(1 - t, t, vec2(corner));
+		const float match = matchGeometry(g, depth);
+		const float w = (b.x * b.y + 0.001f) * match;
+		acc += w * texelFetch(indirectDiffuseBuffer, texel, 0).rgb;
+		weights += w;
+		bestMatch = max(bestMatch, match);
+	}
+
+	if(bestMatch >= MIN_MATCH) return acc / weights;
+
+	// No texel belongs to this surface (e.g. along silhouettes), so the cones have to be traced here.
+	return traceIndirectDiffuse(-1);
+}
+
+// Calculates indirect diffuse light.
+vec3 indirectDiffuseLight(){
+#if (INDIRECT_DIFFUSE_MODE == UPSAMPLE)
+	const vec3 irradiance = upsampleIndirectDiffuse();
+#else
+	const vec3 irradiance = traceIndirectDiffuse(-1);
+#endif
+	return surface.diffuseReflectivity * irradiance * (surface.diffuseColor + vec3(0.001f));
 }
 
 // Calculates indirect specular light using voxel cone tracing.
 vec3 indirectSpecularLight(vec3 viewDirection){
 	const vec3 reflection = normalize(reflect(viewDirection, normal));
-	return material.specularReflectivity * material.specularColor * traceSpecularVoxelCone(worldPositionFrag, reflection);
+	return surface.specularReflectivity * surface.specularColor * traceSpecularVoxelCone(worldPosition, reflection);
 }
 
 // Calculates refractive light using voxel cone tracing.
 vec3 indirectRefractiveLight(vec3 viewDirection){
-	const vec3 refraction = refract(viewDirection, normal, 1.0 / material.refractiveIndex);
-	const vec3 cmix = mix(material.specularColor, 0.5 * (material.specularColor + vec3(1)), material.transparency);
-	return cmix * traceSpecularVoxelCone(worldPositionFrag, refraction);
+	const vec3 refraction = refract(viewDirection, normal, 1.0 / surface.refractiveIndex);
+	const vec3 cmix = mix(surface.specularColor, 0.5 * (surface.specularColor + vec3(1)), surface.transparency);
+	return cmix * traceSpecularVoxelCone(worldPosition, refraction);
 }
 
 // Calculates diffuse and specular direct light for a given point light.  
 // Uses shadow cone tracing for soft shadows.
 vec3 calculateDirectLight(const PointLight light, const vec3 viewDirection){
-	vec3 lightDirection = light.position - worldPositionFrag;
+	vec3 lightDirection = light.position - worldPosition;
 	const float distanceToLight = length(lightDirection);
 	lightDirection = lightDirection / distanceToLight;
 	const float lightAngle = dot(normal, lightDirection);
@@ -276,9 +560,9 @@ vec3 calculateDirectLight(const PointLight light, const vec3 viewDirection){
 #endif
 
 	float refractiveAngle = 0;
-	if(material.transparency > 0.01){
-		vec3 refraction = refract(viewDirection, normal, 1.0 / material.refractiveIndex);
-		refractiveAngle = max(0, material.transparency * dot(refraction, lightDirection));
+	if(surface.transparency > 0.01){
+		vec3 refraction = refract(viewDirection, normal, 1.0 / surface.refractiveIndex);
+		refractiveAngle = max(0, surface.transparency * dot(refraction, lightDirection));
 	}
 
 	// --------------------
@@ -286,8 +570,8 @@ vec3 calculateDirectLight(const PointLight light, const vec3 viewDirection){
 	// --------------------
 	float shadowBlend = 1;
 #if (SHADOWS == 1)
-	if(diffuseAngle * (1.0f - material.transparency) > 0 && settings.shadows)
-		shadowBlend = traceShadowCone(worldPositionFrag, lightDirection, distanceToLight);
+	if(diffuseAngle * (1.0f - surface.transparency) > 0)
+		shadowBlend = traceShadowCone(worldPosition, lightDirection, distanceToLight);
 #endif
 
 	// --------------------
@@ -295,12 +579,12 @@ vec3 calculateDirectLight(const PointLight light, const vec3 viewDirection){
 	// --------------------
 	diffuseAngle = min(shadowBlend, diffuseAngle);
 	specularAngle = min(shadowBlend, max(specularAngle, refractiveAngle));
-	const float df = 1.0f / (1.0f + 0.25f * material.specularDiffusion); // Diffusion factor.
+	const float df = 1.0f / (1.0f + 0.25f * surface.specularDiffusion); // Diffusion factor.
 	const float specular = SPECULAR_FACTOR * pow(specularAngle, df * SPECULAR_POWER);
-	const float diffuse = diffuseAngle * (1.0f - material.transparency);
+	const float diffuse = diffuseAngle * (1.0f - surface.transparency);
 
-	const vec3 diff = material.diffuseReflectivity * material.diffuseColor * diffuse;
-	const vec3 spec = material.specularReflectivity * material.specularColor * specular;
+	const vec3 diff = surface.diffuseReflectivity * surface.diffuseColor * diffuse;
+	const vec3 spec = surface.specularReflectivity * surface.specularColor * specular;
 	const vec3 total = light.color * (diff + spec);
 	return attenuate(distanceToLight) * total;
 };
@@ -314,28 +598,84 @@ vec3 directLight(vec3 viewDirection){
 	return direct;
 }
 
+// Reads the surface of this pixel from the G-buffer. Returns false if there is no geometry.
+// The G-buffer has the full viewport resolution, also when shading the downsampled buffer.
+bool readGBuffer(){
+	const ivec2 texel = ivec2(gl_FragCoord.xy * vec2(imageSize(gBufferPosition)) / screenSize);
+	const vec4 position = imageLoad(gBufferPosition, texel);
+	if(position.w == 0) return false;
+	const vec4 n = imageLoad(gBufferNormal, texel);
+	const vec4 diffuse = imageLoad(gBufferDiffuse, texel);
+	const vec4 specular = imageLoad(gBufferSpecular, texel);
+	const vec4 other = imageLoad(gBufferMaterial, texel);
+	worldPosition = position.xyz;
+	normal = normalize(n.xyz);
+	surface.diffuseColor = diffuse.rgb;
+	surface.diffuseReflectivity = diffuse.a;
+	surface.specularColor = specular.rgb;
+	surface.specularReflectivity = specular.a;
+	surface.specularDiffusion = n.w;
+	surface.emissivity = other.r;
+	surface.refractiveIndex = other.g;
+	surface.transparency = other.b;
+	return true;
+}
+
 void main(){
+	// Find the surface.
+#if (DEFERRED == 1)
+	if(!readGBuffer()) discard;
+#else
+	worldPosition = worldPositionFrag;
+	normal = normalize(normalFrag);
+	surface = material;
+#endif
+#if (VOXEL_STORAGE == CLIPMAP)
+	MAX_DISTANCE = 2 * SQRT3 * clipmapRegions[clipmapCascades - 1].w;
+	MAX_DIFFUSE_DISTANCE = SQRT2 * clipmapRegions[clipmapCascades - 1].w;
+#else
+	MAX_DISTANCE = distance(vec3(abs(worldPosition)), vec3(-1));
+	MAX_DIFFUSE_DISTANCE = SQRT2;
+#endif
+
 	color = vec4(0, 0, 0, 1);
-	const vec3 viewDirection = normalize(worldPositionFrag - cameraPosition);
+	const vec3 viewDirection = normalize(worldPosition - cameraPosition);
+	const bool diffuse = surface.diffuseReflectivity * (1.0f - surface.transparency) > 0.01f;
+
+	// Downsampled indirect diffuse light. Surfaces without it are left out, so they are never upsampled from.
+#if (INDIRECT_DIFFUSE_MODE == TRACE_DOWNSAMPLED || INDIRECT_DIFFUSE_MODE == TRACE_TEMPORAL)
+#if (INDIRECT_DIFFUSE_MODE == TRACE_TEMPORAL)
+	if(diffuse) color = accumulateIndirectDiffuse();
+#else
+	if(diffuse) color.rgb = traceIndirectDiffuse(-1);
+#endif
+	geometry = diffuse ? vec4(normal, distance(worldPosition, cameraPosition)) : vec4(0);
+	return;
+#endif
 
 	// Indirect diffuse light.
-	if(settings.indirectDiffuseLight && material.diffuseReflectivity * (1.0f - material.transparency) > 0.01f) 
+#if (INDIRECT_DIFFUSE_LIGHT == 1)
+	if(diffuse) 
 		color.rgb += indirectDiffuseLight();
+#endif
 
 	// Indirect specular light (glossy reflections).
-	if(settings.indirectSpecularLight && material.specularReflectivity * (1.0f - material.transparency) > 0.01f) 
+#if (INDIRECT_SPECULAR_LIGHT == 1)
+	if(surface.specularReflectivity * (1.0f - surface.transparency) > 0.01f) 
 		color.rgb += indirectSpecularLight(viewDirection);
+#endif
 
 	// Emissivity.
-	color.rgb += material.emissivity * material.diffuseColor;
+	color.rgb += surface.emissivity * surface.diffuseColor;
 
 	// Transparency
-	if(material.transparency > 0.01f)
-		color.rgb = mix(color.rgb, indirectRefractiveLight(viewDirection), material.transparency);
+	if(surface.transparency > 0.01f)
+		color.rgb = mix(color.rgb, indirectRefractiveLight(viewDirection), surface.transparency);
 
 	// Direct light.
-	if(settings.directLight)
-		color.rgb += directLight(viewDirection);
+#if (DIRECT_LIGHT == 1)
+	color.rgb += directLight(viewDirection);
+#endif
 
 #if (GAMMA_CORRECTION == 1)
 	color.rgb = pow(color.rgb, vec3(1.0 / 2.2));
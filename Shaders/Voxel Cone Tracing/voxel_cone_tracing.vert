@@ -5,14 +5,38 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 
+#ifndef MULTI_DRAW
+#define MULTI_DRAW 0 /* Defined by Graphics (see Graphics::multiDrawIndirect). */
+#endif
+#if (MULTI_DRAW == 1)
+// The transform and material setting of every draw of a multi-draw (see Graphics::DrawBlock).
+struct Draw {
+	mat4 M;
+	uint materialIndex;
+};
+layout(std430, binding = 5) readonly buffer Draws { Draw draws[]; };
+layout(location = 2) in uint drawIndex; // The base instance of the draw (see MeshBatch).
+flat out uint materialIndexFrag;
+#else
 uniform mat4 M;
-uniform mat4 V;
-uniform mat4 P;
+#endif
+
+// Per-frame data, shared by all programs (see Graphics::FrameBlock).
+layout(std140, binding = 0) uniform Frame {
+	mat4 V;
+	mat4 P;
+	vec3 cameraPosition; // World camera position.
+	int state; // Only used for testing / debugging.
+};
 
 out vec3 worldPositionFrag;
 out vec3 normalFrag;
 
 void main(){
+#if (MULTI_DRAW == 1)
+	const mat4 M = draws[drawIndex].M;
+	materialIndexFrag = draws[drawIndex].materialIndex;
+#endif
 	worldPositionFrag = vec3(M * vec4(position, 1));
 	normalFrag = normalize(mat3(transpose(inverse(M))) * normal);
 	gl_Position = P * V * vec4(worldPositionFrag, 1);
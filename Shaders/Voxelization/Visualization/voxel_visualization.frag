@@ -6,11 +6,26 @@
 #define INV_STEP_LENGTH (1.0f/STEP_LENGTH)
 #define STEP_LENGTH 0.005f
 
+// Voxel storage (see Graphics::VoxelStorage).
+#define SPARSE_VOXEL_OCTREE 1
+
+// Per-frame data, shared by all programs (see Graphics::FrameBlock).
+layout(std140, binding = 0) uniform Frame {
+	mat4 V;
+	mat4 P;
+	vec3 cameraPosition; // World camera position.
+	int state; // Decides mipmap sample level.
+};
+
 uniform sampler2D textureBack; // Unit cube back FBO.
 uniform sampler2D textureFront; // Unit cube front FBO.
 uniform sampler3D texture3D; // Texture in which voxelization is stored.
-uniform vec3 cameraPosition; // World camera position.
-uniform int state = 0; // Decides mipmap sample level.
+uniform int voxelStorage; // How the voxelized scene is stored (see Graphics::VoxelStorage).
+uniform int octreeLevels; // Number of levels in the sparse voxel octree, i.e. log2 of its resolution.
+
+// Sparse voxel octree node and brick pools (see SparseVoxelOctree.h).
+layout(std430, binding = 1) readonly buffer OctreeNodes { uint octreeNodes[]; };
+layout(std430, binding = 2) readonly buffer OctreeBricks { uint octreeBricks[]; };
 
 in vec2 textureCoordinateFrag; 
 out vec4 color;
@@ -21,8 +36,28 @@ vec3 scaleAndBias(vec3 p) { return 0.5f * p + vec3(0.5f); }
 // Returns true if p is inside the unity cube (+ e) centered on (0, 0, 0).
 bool isInsideCube(vec3 p, float e) { return abs(p.x) < 1 + e && abs(p.y) < 1 + e && abs(p.z) < 1 + e; }
 
+// Returns the voxel at an integer position on a given level of the sparse voxel octree.
+// The top level (a single voxel) is the average of the root tile's brick.
+vec4 fetchOctree(const ivec3 voxel, const int level){
+	if(any(lessThan(voxel, ivec3(0))) || any(greaterThanEqual(voxel, ivec3(1 << (octreeLevels - level))))) return vec4(0);
+	if(level == octreeLevels){
+		vec4 acc = vec4(0);
+		for(int i = 0; i < 8; ++i) acc += unpackUnorm4x8(octreeBricks[i]);
+		return acc / 8;
+	}
+	uint tile = 0;
+	for(int l = octreeLevels - 1; l > level; --l){
+		const ivec3 octant = (voxel >> (l - level)) & 1;
+		tile = octreeNodes[8 * tile + octant.x + 2 * octant.y + 4 * octant.z];
+		if(tile == 0) return vec4(0);
+	}
+	const ivec3 octant = voxel & 1;
+	return unpackUnorm4x8(octreeBricks[8 * tile + octant.x + 2 * octant.y + 4 * octant.z]);
+}
+
 void main() {
 	const float mipmapLevel = state;
+	const int octreeLevel = clamp(state, 0, octreeLevels);
 
 	// Initialize ray.
 	const vec3 origin = isInsideCube(cameraPosition, 0.2f) ? 
@@ -36,7 +71,9 @@ void main() {
 	for(uint step = 0; step < numberOfSteps && color.a < 0.99f; ++step) {
 		const vec3 currentPoint = origin + STEP_LENGTH * step * direction;
 		vec3 coordinate = scaleAndBias(currentPoint);
-		vec4 currentSample = textureLod(texture3D, scaleAndBias(currentPoint), mipmapLevel);
+		vec4 currentSample = voxelStorage == SPARSE_VOXEL_OCTREE ?
+			fetchOctree(ivec3(coordinate * (1 << (octreeLevels - octreeLevel))), octreeLevel) :
+			textureLod(texture3D, scaleAndBias(currentPoint), mipmapLevel);
 		color += (1.0f - color.a) * currentSample;
 	} 
 	color.rgb = pow(color.rgb, vec3(1.0 / 2.2));
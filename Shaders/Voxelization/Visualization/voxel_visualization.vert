@@ -2,8 +2,6 @@
 // Date:	11/26/2016
 #version 450 core
 
-uniform mat4 V;
-
 layout(location = 0) in vec3 position;
 out vec2 textureCoordinateFrag; 
 
@@ -5,8 +5,14 @@
 layout(location = 0) in vec3 position;
 
 uniform mat4 M;
-uniform mat4 V;
-uniform mat4 P;
+
+// Per-frame data, shared by all programs (see Graphics::FrameBlock).
+layout(std140, binding = 0) uniform Frame {
+	mat4 V;
+	mat4 P;
+	vec3 cameraPosition; // World camera position.
+	int state; // Only used for testing / debugging.
+};
 
 out vec3 worldPosition;
 
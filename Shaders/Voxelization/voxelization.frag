@@ -5,7 +5,12 @@
 
 // Lighting settings.
 #define POINT_LIGHT_INTENSITY 1
-#define MAX_LIGHTS 1
+#ifndef MAX_LIGHTS
+#define MAX_LIGHTS 1 /* Defined by Graphics (see Graphics::maxLights). */
+#endif
+#ifndef MULTI_DRAW
+#define MULTI_DRAW 0 /* Defined by Graphics (see Graphics::multiDrawIndirect). */
+#endif
 
 // Lighting attenuation factors.
 #define DIST_FACTOR 1.1f /* Distance is multiplied by this when calculating attenuation. */
@@ -21,23 +26,63 @@ struct PointLight {
 	vec3 color;
 };
 
+// The lights of the scene (see Graphics::PointLightBlock).
+layout(std140, binding = 1) uniform Lights {
+	int numberOfLights; // Number of lights currently uploaded.
+	PointLight pointLights[MAX_LIGHTS];
+};
+
 struct Material {
 	vec3 diffuseColor;
-	vec3 specularColor;
 	float diffuseReflectivity;
+	vec3 specularColor;
+	float specularDiffusion;
 	float specularReflectivity;
 	float emissivity;
+	float refractiveIndex;
 	float transparency;
 };
 
-uniform Material material;
-uniform PointLight pointLights[MAX_LIGHTS];
-uniform int numberOfLights;
-uniform vec3 cameraPosition;
-layout(RGBA8) uniform image3D texture3D;
+#if (MULTI_DRAW == 1)
+// The material settings of all renderers, indexed by the draw (see Graphics::uploadUniformBuffers).
+layout(std430, binding = 6) readonly buffer MaterialSettings { Material materials[]; };
+flat in uint materialIndexFrag;
+#define material materials[materialIndexFrag]
+#else
+// The material setting of the renderer being drawn (see Graphics::MaterialBlock).
+layout(std140, binding = 2) uniform MaterialSettings {
+	Material material;
+};
+#endif
+
+uniform bool conservative; // Whether to use conservative rasterization or not (see voxelization.geom).
+uniform int voxelGridSize; // Resolution of the voxel grid (i.e. of the viewport).
+uniform vec4 voxelGridRegion; // World space center (xyz) and half extent (w) of the voxel grid.
+uniform bool toroidal; // Whether voxel coordinates are relative to the world origin and wrap around (clipmap cascades).
+uniform ivec3 updateMin; // Only voxels in [updateMin, updateMax) are written.
+uniform ivec3 updateMax;
+uniform bool fragmentList; // Whether to append voxel fragments to the fragment list instead of writing them to texture3D.
+uniform bool averageFragments; // Whether to accumulate fragments in the accumulation buffer instead of writing them to texture3D.
+uniform bool lightInjection; // Whether to write the surface instead of lighting it. The voxels are lit by inject_light.comp.
+layout(RGBA8) uniform image3D texture3D; // The lit voxels, or their albedo if lightInjection.
+layout(RGBA8) uniform image3D normalVolume; // Only written if lightInjection.
+layout(RGBA8) uniform image3D emissionVolume; // Only written if lightInjection.
+
+// Voxel fragment list, used to build the sparse voxel octree (see SparseVoxelOctree.h).
+// Positions are packed as x | y << 10 | z << 20. Fragments that don't fit are counted but dropped.
+layout(std430, binding = 0) writeonly buffer FragmentList { uvec2 fragments[]; };
+layout(binding = 0, offset = 0) uniform atomic_uint fragmentCount;
+
+// Voxel accumulation buffer, resolved into texture3D (and the surface volumes) by average_voxels.comp. Every voxel has
+// 1 + 2 * layers entries: the number of fragments, followed by the sums of the fragments' RGBA8 values packed as
+// r | g << 16 and b | a << 16 for every layer. Integer sums make the average independent of the order of the fragments.
+// The sums are 16 bits, so at most MAX_FRAGMENTS are accumulated.
+#define MAX_FRAGMENTS 257
+layout(std430, binding = 3) coherent buffer VoxelAccumulation { uint accumulation[]; };
 
 in vec3 worldPositionFrag;
 in vec3 normalFrag;
+flat in vec4 triangleAABB;
 
 vec3 calculatePointLight(const PointLight light){
 	const vec3 direction = normalize(light.position - worldPositionFrag);
@@ -47,25 +92,62 @@ vec3 calculatePointLight(const PointLight light){
 	return d * POINT_LIGHT_INTENSITY * attenuation * light.color;
 };
 
-vec3 scaleAndBias(vec3 p) { return 0.5f * p + vec3(0.5f); }
-
-bool isInsideCube(const vec3 p, float e) { return abs(p.x) < 1 + e && abs(p.y) < 1 + e && abs(p.z) < 1 + e; }
-
 void main(){
 	vec3 color = vec3(0.0f);
-	if(!isInsideCube(worldPositionFrag, 0)) return;
 
-	// Calculate diffuse lighting fragment contribution.
-	const uint maxLights = min(numberOfLights, MAX_LIGHTS);
-	for(uint i = 0; i < maxLights; ++i) color += calculatePointLight(pointLights[i]);
+	// Find the voxel, and skip it if it's outside of the region that is being updated.
+	const float voxelEdge = 2 * voxelGridRegion.w / voxelGridSize;
+	const vec3 origin = toroidal ? vec3(0) : voxelGridRegion.xyz - voxelGridRegion.w;
+	const ivec3 voxel = ivec3(floor((worldPositionFrag - origin) / voxelEdge));
+	if(any(lessThan(voxel, updateMin)) || any(greaterThanEqual(voxel, updateMax))) return;
+	const ivec3 position = voxel & (voxelGridSize - 1);
+
+	// Clip the expanded triangle to its bounding box.
+	if(conservative){
+		const vec2 p = 2.0f * gl_FragCoord.xy / float(voxelGridSize) - vec2(1.0f);
+		if(any(lessThan(p, triangleAABB.xy)) || any(greaterThan(p, triangleAABB.zw))) discard;
+	}
+
+	// Surface. Albedo and emission are premultiplied by alpha, so lighting them after averaging gives the same result
+	// as averaging the lit fragments (apart from using the voxel center and the average normal).
+	float alpha = pow(1 - material.transparency, 4); // For soft shadows to work better with transparent materials.
 	vec3 spec = material.specularReflectivity * material.specularColor;
 	vec3 diff = material.diffuseReflectivity * material.diffuseColor;
-	color = (diff + spec) * color + clamp(material.emissivity, 0, 1) * material.diffuseColor;
+	vec3 emission = clamp(material.emissivity, 0, 1) * material.diffuseColor;
+	vec4 layers[3] = {
+		alpha * vec4(diff + spec, 1),
+		vec4(0.5f * normalize(normalFrag) + 0.5f, 1),
+		vec4(alpha * emission, 1)
+	};
+	const int numberOfLayers = lightInjection ? 3 : 1;
 
-	// Output lighting to 3D texture.
-	vec3 voxel = scaleAndBias(worldPositionFrag);
-	ivec3 dim = imageSize(texture3D);
-	float alpha = pow(1 - material.transparency, 4); // For soft shadows to work better with transparent materials.
-	vec4 res = alpha * vec4(vec3(color), 1);
-    imageStore(texture3D, ivec3(dim * voxel), res);
+	// Calculate diffuse lighting fragment contribution.
+	if(!lightInjection){
+		const uint maxLights = min(numberOfLights, MAX_LIGHTS);
+		for(uint i = 0; i < maxLights; ++i) color += calculatePointLight(pointLights[i]);
+		layers[0] = alpha * vec4((diff + spec) * color + emission, 1);
+	}
+
+	// Output lighting to 3D texture (or to the fragment list).
+	vec4 res = layers[0];
+	if(fragmentList){
+		const uint i = atomicCounterIncrement(fragmentCount);
+		if(i < fragments.length()) fragments[i] = uvec2(position.x | position.y << 10 | position.z << 20, packUnorm4x8(res));
+		return;
+	}
+	if(averageFragments){
+		const uint i = (1 + 2 * numberOfLayers) * (position.x + voxelGridSize * (position.y + voxelGridSize * position.z));
+		if(atomicAdd(accumulation[i], 1) >= MAX_FRAGMENTS) return;
+		for(int layer = 0; layer < numberOfLayers; ++layer){
+			const uvec4 c = uvec4(round(clamp(layers[layer], 0, 1) * 255));
+			atomicAdd(accumulation[i + 1 + 2 * layer], c.r | c.g << 16);
+			atomicAdd(accumulation[i + 2 + 2 * layer], c.b | c.a << 16);
+		}
+		return;
+	}
+    imageStore(texture3D, position, res);
+	if(lightInjection){
+		imageStore(normalVolume, position, layers[1]);
+		imageStore(emissionVolume, position, layers[2]);
+	}
 }
\ No newline at end of file
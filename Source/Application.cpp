@@ -122,14 +122,44 @@ void Application::init() {
 	TwAddVarRW(mainTweakBar, "Direct light", TW_TYPE_BOOL8, &graphics.directLight, "group=Settings");
 	TwAddVarRW(mainTweakBar, "Indirect diffuse light", TW_TYPE_BOOL8, &graphics.indirectDiffuseLight, "group=Settings");
 	TwAddVarRW(mainTweakBar, "Indirect specular light", TW_TYPE_BOOL8, &graphics.indirectSpecularLight, "group=Settings");
+	TwAddVarRW(mainTweakBar, "Gamma correction", TW_TYPE_BOOL8, &graphics.gammaCorrection, "group=Settings");
+	TwType specularMode = TwDefineEnum("SpecularMode", NULL, 0);
+	TwAddVarRW(mainTweakBar, "Specular mode", specularMode, &graphics.specularMode, "enum='0 {Blinn-Phong}, 1 {Reflection}' group=Settings");
+	TwAddVarRW(mainTweakBar, "Max lights", TW_TYPE_INT32, &graphics.maxLights, "min=1 max=8 group=Settings");
+	TwAddVarRW(mainTweakBar, "Deferred shading", TW_TYPE_BOOL8, &graphics.deferredShading, "group=Settings");
+	TwAddVarRW(mainTweakBar, "Multi-draw indirect", TW_TYPE_BOOL8, &graphics.multiDrawIndirect, "group=Settings");
+	TwAddVarRW(mainTweakBar, "Packed vertex data", TW_TYPE_BOOL8, &graphics.packedVertexData, "group=Settings");
+	TwAddVarRW(mainTweakBar, "Queue multi-draw validation", TW_TYPE_BOOL8, &graphics.multiDrawValidationQueued, "group=Settings");
+	TwType indirectDiffuseDownsampling = TwDefineEnum("IndirectDiffuseDownsampling", NULL, 0);
+	TwAddVarRW(mainTweakBar, "Indirect diffuse resolution", indirectDiffuseDownsampling, &graphics.indirectDiffuseDownsampling, "enum='1 {Full}, 2 {Half}, 4 {Quarter}' group=Settings");
+	TwType diffuseCones = TwDefineEnum("DiffuseCones", NULL, 0);
+	TwAddVarRW(mainTweakBar, "Indirect diffuse cones", diffuseCones, &graphics.diffuseCones, "enum='1 {1}, 5 {5}, 6 {6}, 9 {9}, 16 {16}' group=Settings");
+	TwAddVarRW(mainTweakBar, "Temporal indirect diffuse", TW_TYPE_BOOL8, &graphics.temporalIndirectDiffuse, "group=Settings");
 
 	temp = "mainsep2";
 	TwAddSeparator(mainTweakBar, temp, NULL);
 	TwAddVarRW(mainTweakBar, "Autogen voxelization", TW_TYPE_BOOL8, &graphics.automaticallyVoxelize, "group=Voxelization");
 	TwAddVarRW(mainTweakBar, "Queue voxelization gen", TW_TYPE_BOOL8, &graphics.voxelizationQueued, "group=Voxelization");
 	TwAddVarRW(mainTweakBar, "Voxelization sparsity", TW_TYPE_INT32, &graphics.voxelizationSparsity, "group=Voxelization");
+	TwType voxelTextureSize = TwDefineEnum("VoxelTextureSize", NULL, 0);
+	TwAddVarRW(mainTweakBar, "Voxel texture size", voxelTextureSize, &graphics.voxelTextureSize, "enum='32 {32}, 64 {64}, 128 {128}, 256 {256}, 512 {512}' group=Voxelization");
 	TwAddVarRW(mainTweakBar, "Autogen mipmap", TW_TYPE_BOOL8, &graphics.automaticallyRegenerateMipmap, "group=Voxelization");
 	TwAddVarRW(mainTweakBar, "Queue mipmap gen", TW_TYPE_BOOL8, &graphics.regenerateMipmapQueued, "group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Conservative voxelization", TW_TYPE_BOOL8, &graphics.conservativeVoxelization, "group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Average voxel fragments", TW_TYPE_BOOL8, &graphics.averageVoxelFragments, "group=Voxelization");
+	TwAddVarRW(mainTweakBar, "CPU voxelization", TW_TYPE_BOOL8, &graphics.cpuVoxelization, "group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Queue voxelization validation", TW_TYPE_BOOL8, &graphics.voxelizationValidationQueued, "group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Incremental voxelization", TW_TYPE_BOOL8, &graphics.incrementalVoxelization, "group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Compute shader mipmaps", TW_TYPE_BOOL8, &graphics.computeShaderMipmaps, "group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Anisotropic voxels", TW_TYPE_BOOL8, &graphics.anisotropicVoxels, "group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Voxel light injection", TW_TYPE_BOOL8, &graphics.voxelLightInjection, "group=Voxelization");
+	TwType voxelStorage = TwDefineEnum("VoxelStorage", NULL, 0);
+	TwAddVarRW(mainTweakBar, "Voxel storage", voxelStorage, &graphics.voxelStorage, "enum='0 {Dense texture}, 1 {Sparse voxel octree}, 2 {Clipmap}' group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Octree levels", TW_TYPE_INT32, &graphics.sparseVoxelOctreeLevels, "min=1 max=10 group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Queue octree validation", TW_TYPE_BOOL8, &graphics.sparseVoxelOctreeValidationQueued, "group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Clipmap cascades", TW_TYPE_INT32, &graphics.clipmapCascades, "min=1 max=6 group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Clipmap extent", TW_TYPE_FLOAT, &graphics.clipmapExtent, "min=0.1 step=0.1 group=Voxelization");
+	TwAddVarRW(mainTweakBar, "Voxelization LOD error", TW_TYPE_FLOAT, &graphics.voxelizationLevelOfDetail, "min=0 max=4 step=0.1 group=Voxelization");
 
 	// Point lights.
 	TwStructMember pointMembers[] = {
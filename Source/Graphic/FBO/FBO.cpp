@@ -2,8 +2,10 @@
 
 #include <iostream>
 
-FBO::FBO(GLuint w, GLuint h, GLenum magFilter, GLenum minFilter, GLint internalFormat, GLint format, GLint wrap)
-	: width(w), height(h)
+#include "../Material/Material.h"
+
+FBO::FBO(GLuint w, GLuint h, GLenum _magFilter, GLenum _minFilter, GLint internalFormat, GLint format, GLint _wrap)
+	: width(w), height(h), magFilter(_magFilter), minFilter(_minFilter), wrap(_wrap)
 {
 	GLint previousFrameBuffer;
 	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFrameBuffer);
@@ -12,16 +14,7 @@ FBO::FBO(GLuint w, GLuint h, GLenum magFilter, GLenum minFilter, GLint internalF
 	glGenFramebuffers(1, &frameBuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
 
-	glGenTextures(1, &textureColorBuffer);
-	glBindTexture(GL_TEXTURE_2D, textureColorBuffer);
-
-	// Texture parameters.
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, GL_RGBA, format, NULL);
+	textureColorBuffer = generateColorBuffer(internalFormat, format);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureColorBuffer, 0);
 
 	glGenRenderbuffers(1, &rbo);
@@ -33,6 +26,40 @@ FBO::FBO(GLuint w, GLuint h, GLenum magFilter, GLenum minFilter, GLint internalF
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "FBO failed to initialize correctly." << std::endl; }
 }
 
+GLuint FBO::generateColorBuffer(GLint internalFormat, GLint format)
+{
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	// Texture parameters.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, format, NULL);
+	return textureID;
+}
+
+void FBO::AddColorAttachment(GLint internalFormat, GLint format)
+{
+	GLint previousFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFrameBuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+
+	additionalColorBuffers.push_back(generateColorBuffer(internalFormat, format));
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + additionalColorBuffers.size(), GL_TEXTURE_2D, additionalColorBuffers.back(), 0);
+
+	// Draw to all attachments.
+	std::vector<GLenum> drawBuffers;
+	for (unsigned int i = 0; i <= additionalColorBuffers.size(); ++i) drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+	glDrawBuffers(drawBuffers.size(), drawBuffers.data());
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cerr << "FBO color attachment failed to initialize correctly." << std::endl; }
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFrameBuffer);
+}
+
 GLuint FBO::generateAttachment(GLuint w, GLuint h, GLboolean depth, GLboolean stencil, GLenum magFilter, GLenum minFilter, GLenum wrap)
 {
 	GLenum attachment_type;
@@ -63,15 +90,17 @@ GLuint FBO::generateAttachment(GLuint w, GLuint h, GLboolean depth, GLboolean st
 	return textureID;
 }
 
-void FBO::ActivateAsTexture(const int shaderProgram, const std::string glSamplerName, const int textureUnit)
+void FBO::ActivateAsTexture(const Material * material, const std::string & glSamplerName, const int textureUnit, const unsigned int colorAttachment)
 {
 	glActiveTexture(GL_TEXTURE0 + textureUnit);
-	glBindTexture(GL_TEXTURE_2D, textureColorBuffer);
-	glUniform1i(glGetUniformLocation(shaderProgram, glSamplerName.c_str()), textureUnit);
+	glBindTexture(GL_TEXTURE_2D, GetColorBuffer(colorAttachment));
+	glUniform1i(material->getUniformLocation(glSamplerName), textureUnit);
 }
 
 FBO::~FBO()
 {
 	glDeleteTextures(1, &textureColorBuffer);
+	if (!additionalColorBuffers.empty()) glDeleteTextures(additionalColorBuffers.size(), additionalColorBuffers.data());
+	glDeleteRenderbuffers(1, &rbo);
 	glDeleteFramebuffers(1, &frameBuffer);
 }
\ No newline at end of file
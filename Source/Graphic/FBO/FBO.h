@@ -3,18 +3,37 @@
 #define GLEW_STATIC
 #include <glew.h>
 
+#include <string>
 #include <vector>
 
+class Material;
+
 // https://www.opengl.org/wiki/Framebuffer_Object_Examples
 /// <summary> An FBO. Manages important OpenGL calls. </summary>
 class FBO {
 public:
 	GLuint width, height, frameBuffer, textureColorBuffer, attachment, rbo;
-	void ActivateAsTexture(const int shaderProgram, const std::string glSamplerName, const int textureUnit = GL_TEXTURE0);
+	std::vector<GLuint> additionalColorBuffers; // GL_COLOR_ATTACHMENT1 and onwards (see AddColorAttachment).
+
+	/// <summary> Activates a color attachment (0 is textureColorBuffer) and passes it on to a texture unit on the GPU. </summary>
+	void ActivateAsTexture(const Material * material, const std::string & glSamplerName, const int textureUnit = GL_TEXTURE0, const unsigned int colorAttachment = 0);
+
+	/// <summary> Adds a color attachment with the same size and filtering as the first one, i.e. another render target
+	/// (fragment shader output location) when this FBO is drawn to. </summary>
+	void AddColorAttachment(GLint internalFormat = GL_RGBA16F, GLint format = GL_FLOAT);
+
+	/// <summary> Returns the texture of a color attachment (0 is textureColorBuffer). </summary>
+	GLuint GetColorBuffer(const unsigned int colorAttachment) const {
+		return colorAttachment == 0 ? textureColorBuffer : additionalColorBuffers[colorAttachment - 1];
+	}
+
 	FBO(
 		GLuint w, GLuint h, GLenum magFilter = GL_NEAREST, GLenum minFilter = GL_NEAREST,
 		GLint internalFormat = GL_RGB16F, GLint format = GL_FLOAT, GLint wrap = GL_REPEAT);
 	~FBO();
 private:
+	GLenum magFilter, minFilter;
+	GLint wrap;
+	GLuint generateColorBuffer(GLint internalFormat, GLint format);
 	GLuint generateAttachment(GLuint w, GLuint h, GLboolean depth, GLboolean stencil, GLenum magFilter, GLenum minFilter, GLenum wrap);
 };
\ No newline at end of file
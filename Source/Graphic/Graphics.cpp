@@ -3,7 +3,12 @@
 // Stdlib.
 #include <queue>
 #include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdlib>
 #include <vector>
+#include <string>
+#include <iostream>
 
 // External.
 #include <glm.hpp>
@@ -22,6 +27,18 @@
 #include "../Shape/Shape.h"
 #include "../Application.h"
 
+namespace {
+	/// <summary> Returns true if any light has been added, removed, moved or recolored. </summary>
+	bool pointLightsChanged(const std::vector<PointLight> & pointLights, const std::vector<PointLight> & previousPointLights) {
+		if (pointLights.size() != previousPointLights.size()) return true;
+		for (unsigned int i = 0; i < pointLights.size(); ++i) {
+			const PointLight & light = pointLights[i], & previous = previousPointLights[i];
+			if (light.position != previous.position || light.color != previous.color) return true;
+		}
+		return false;
+	}
+}
+
 // ----------------------
 // Rendering pipeline.
 // ----------------------
@@ -29,18 +46,45 @@ void Graphics::init(unsigned int viewportWidth, unsigned int viewportHeight)
 {
 	glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
 	glEnable(GL_MULTISAMPLE); // MSAA. Set MSAA level using GLFW (see Application.cpp).
-	voxelConeTracingMaterial = MaterialStore::getInstance().findMaterialWithName("voxel_cone_tracing");
+	initUniformBuffers();
 	voxelCamera = OrthographicCamera(viewportWidth / float(viewportHeight));
 	initVoxelization();
+	initSparseVoxelOctree();
 	initVoxelVisualization(viewportWidth, viewportHeight);
 }
 
 void Graphics::render(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight, RenderingMode renderingMode)
 {
+	// Resize the voxel texture if the resolution has been changed. The surface volumes are allocated along with it.
+	if (voxelTexture->width != voxelTextureSize || voxelLightInjection == surfaceVoxelTextures.empty()) {
+		initVoxelTexture();
+		voxelizationQueued = true;
+	}
+
+	// The directional volumes are built along with the mipmap, so the scene is voxelized when they are turned on.
+	if (voxelStorage == VoxelStorage::DENSE_TEXTURE && anisotropicVoxels && anisotropicVoxelTextures.empty()) {
+		voxelizationQueued = regenerateMipmapQueued = true;
+	}
+	else if (!anisotropicVoxels && !anisotropicVoxelTextures.empty()) {
+		for (auto * texture : anisotropicVoxelTextures) delete texture;
+		anisotropicVoxelTextures.clear();
+	}
+
+	// The world matrices, the camera, the lights and the material settings are shared by voxelization and rendering.
+	updateRenderers(renderingScene);
+	uploadUniformBuffers(renderingScene);
+
 	// Voxelize.
-	bool voxelizeNow = voxelizationQueued || (automaticallyVoxelize && voxelizationSparsity > 0 && ++ticksSinceLastVoxelization >= voxelizationSparsity);
-	if (voxelizeNow) {
+	if (voxelStorage == VoxelStorage::SPARSE_VOXEL_OCTREE) checkSparseVoxelOctreeCapacity();
+	bool voxelizeNow = voxelizationQueued || voxelizationValidationQueued || sparseVoxelOctreeValidationQueued || (automaticallyVoxelize && voxelizationSparsity > 0 && ++ticksSinceLastVoxelization >= voxelizationSparsity);
+	if (voxelizationQueued) staticVoxelizationQueued = sparseVoxelOctreeQueued = true;
+	if (voxelStorage == VoxelStorage::CLIPMAP) {
+		updateClipmap(renderingScene, voxelizeNow); // The clipmap follows the camera every frame.
+	}
+	else if (voxelizeNow) {
 		voxelize(renderingScene, true);
+	}
+	if (voxelizeNow) {
 		ticksSinceLastVoxelization = 0;
 		voxelizationQueued = false;
 	}
@@ -48,9 +92,10 @@ void Graphics::render(Scene & renderingScene, unsigned int viewportWidth, unsign
 	// Render.
 	switch (renderingMode) {
 	case RenderingMode::VOXELIZATION_VISUALIZATION:
-		renderVoxelVisualization(renderingScene, viewportWidth, viewportHeight);
+		renderVoxelVisualization(viewportWidth, viewportHeight);
 		break;
 	case RenderingMode::VOXEL_CONE_TRACING:
+		if (multiDrawValidationQueued) validateMultiDraw(renderingScene, viewportWidth, viewportHeight);
 		renderScene(renderingScene, viewportWidth, viewportHeight);
 		break;
 	}
@@ -61,13 +106,18 @@ void Graphics::render(Scene & renderingScene, unsigned int viewportWidth, unsign
 // ----------------------
 void Graphics::renderScene(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight)
 {
-	// Fetch references.
-	auto & camera = *renderingScene.renderingCamera;
-	const Material * material = voxelConeTracingMaterial;
-	const GLuint program = material->program;
+	const bool upsample = indirectDiffuseLight && (indirectDiffuseDownsampling > 1 || temporalIndirectDiffuse);
+	const Material * material = getVoxelConeTracingMaterial(upsample ? UPSAMPLE : TRACE_PER_FRAGMENT);
+
+	// Write the surfaces to the G-buffer first, so that they are shaded once per pixel.
+	if (deferredShading) renderGBuffer(renderingScene, viewportWidth, viewportHeight);
+
+	// Trace indirect diffuse light at a lower resolution (or over several frames) first.
+	if (upsample) renderIndirectDiffuse(renderingScene, viewportWidth, viewportHeight);
+	else temporalHistory = false; // The history is outdated once a frame hasn't been accumulated.
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glUseProgram(program);
+	glUseProgram(material->program);
 
 	// GL Settings.
 	glViewport(0, 0, viewportWidth, viewportHeight);
@@ -81,104 +131,1211 @@ void Graphics::renderScene(Scene & renderingScene, unsigned int viewportWidth, u
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Upload uniforms.
-	uploadCamera(camera, program);
-	uploadGlobalConstants(program, viewportWidth, viewportHeight);
-	uploadLighting(renderingScene, program);
-	uploadRenderingSettings(program);
+	uploadGlobalConstants(material, viewportWidth, viewportHeight);
+	uploadVoxelStorage(material);
+	uploadIndirectDiffuse(material, upsample ? UPSAMPLE : TRACE_PER_FRAGMENT);
+	uploadGBuffer(material);
 
 	// Render.
-	renderQueue(renderingScene.renderers, material->program, true);
+	renderConeTracedSurfaces(renderingScene, material);
 }
 
-void Graphics::uploadLighting(Scene & renderingScene, const GLuint program) const
+void Graphics::validateMultiDraw(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight)
 {
-	// Point lights.
-	for (unsigned int i = 0; i < renderingScene.pointLights.size(); ++i) renderingScene.pointLights[i].Upload(program, i);
+	multiDrawValidationQueued = false;
 
-	// Number of point lights.
-	glUniform1i(glGetUniformLocation(program, NUMBER_OF_LIGHTS_NAME), renderingScene.pointLights.size());
+	// Both frames have to trace the same cones, so temporal accumulation is paused (and restarted afterwards).
+	const bool multiDraw = multiDrawIndirect, temporal = temporalIndirectDiffuse;
+	temporalIndirectDiffuse = false;
+	std::vector<unsigned char> frames[2];
+	for (int i = 0; i < 2; ++i) {
+		multiDrawIndirect = i == 1;
+		renderScene(renderingScene, viewportWidth, viewportHeight);
+		frames[i].resize(4 * viewportWidth * viewportHeight);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, viewportWidth, viewportHeight, GL_RGBA, GL_UNSIGNED_BYTE, frames[i].data());
+	}
+	multiDrawIndirect = multiDraw;
+	temporalIndirectDiffuse = temporal;
+
+	unsigned int differentPixels = 0, maxDifference = 0;
+	for (size_t i = 0; i < frames[0].size(); i += 4) {
+		unsigned int difference = 0;
+		for (unsigned int k = 0; k < 3; ++k) difference = std::max(difference, (unsigned int)std::abs(int(frames[0][i + k]) - int(frames[1][i + k])));
+		if (difference > 0) ++differentPixels;
+		maxDifference = std::max(maxDifference, difference);
+	}
+	std::cout << "- Multi-draw validation (" << viewportWidth << "x" << viewportHeight << "): " << differentPixels
+		<< " pixels differ from drawing renderer by renderer, by at most " << maxDifference << "/255." << std::endl;
 }
 
-void Graphics::uploadRenderingSettings(const GLuint glProgram) const
+Material * Graphics::getVoxelConeTracingMaterial(IndirectDiffuseMode indirectDiffuseMode) const
 {
-	glUniform1i(glGetUniformLocation(glProgram, "settings.shadows"), shadows);
-	glUniform1i(glGetUniformLocation(glProgram, "settings.indirectDiffuseLight"), indirectDiffuseLight);
-	glUniform1i(glGetUniformLocation(glProgram, "settings.indirectSpecularLight"), indirectSpecularLight);
-	glUniform1i(glGetUniformLocation(glProgram, "settings.directLight"), directLight);
+	// Disabled features are compiled out instead of being branched on.
+	ShaderDefines defines;
+	defines.set("INDIRECT_DIFFUSE_MODE", indirectDiffuseMode);
+	defines.set("DEFERRED", deferredShading).set("DIFFUSE_CONES", diffuseCones).set("MAX_LIGHTS", maxLights);
+	defines.set("MULTI_DRAW", multiDrawIndirect && !deferredShading); // The deferred surfaces are a screen quad.
+	defines.set("DIRECT_LIGHT", directLight).set("INDIRECT_DIFFUSE_LIGHT", indirectDiffuseLight).set("INDIRECT_SPECULAR_LIGHT", indirectSpecularLight);
+	defines.set("SHADOWS", shadows).set("SPECULAR_MODE", specularMode).set("GAMMA_CORRECTION", gammaCorrection);
+
+	// The voxel storage is branched on for every sample of every cone.
+	defines.set("VOXEL_STORAGE", voxelStorage);
+	defines.set("ANISOTROPIC_VOXELS", voxelStorage == VoxelStorage::DENSE_TEXTURE && !anisotropicVoxelTextures.empty());
+
+	const char * name = deferredShading ? "voxel_cone_tracing_deferred" : "voxel_cone_tracing";
+	return MaterialStore::getInstance().findMaterialVariant(name, defines);
 }
 
-void Graphics::uploadGlobalConstants(const GLuint program, unsigned int viewportWidth, unsigned int viewportHeight) const
+Material * Graphics::getLightingMaterial(const std::string & name, ShaderDefines defines) const
 {
-	glUniform1i(glGetUniformLocation(program, APP_STATE_NAME), Application::getInstance().state);
-	glm::vec2 screenSize(viewportWidth, viewportHeight);
+	return MaterialStore::getInstance().findMaterialVariant(name, defines.set("MAX_LIGHTS", maxLights));
+}
+
+void Graphics::renderConeTracedSurfaces(Scene & renderingScene, const Material * material)
+{
+	if (!deferredShading) {
+		renderQueue(renderingScene.renderers, material, true);
+		return;
+	}
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	quadMeshRenderer->render(material);
+}
+
+// ----------------------
+// Deferred shading.
+// ----------------------
+void Graphics::renderGBuffer(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight)
+{
+	const Material * material = getGBufferMaterial();
+
+	// (Re)allocate the G-buffer if the viewport has changed.
+	if (gBuffer == nullptr || gBuffer->width != viewportWidth || gBuffer->height != viewportHeight) {
+		if (gBuffer) delete gBuffer;
+		gBuffer = new FBO(viewportWidth, viewportHeight, GL_NEAREST, GL_NEAREST, GL_RGBA32F, GL_FLOAT, GL_CLAMP_TO_EDGE);
+		for (unsigned int i = 1; i < 5; ++i) gBuffer->AddColorAttachment(GL_RGBA16F, GL_FLOAT);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, gBuffer->frameBuffer);
+	glUseProgram(material->program);
+
+	// GL Settings. Pixels without geometry are cleared to w = 0 (see gbuffer.frag).
+	glViewport(0, 0, viewportWidth, viewportHeight);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+	glDisable(GL_BLEND);
+
+	// Render.
+	renderQueue(renderingScene.renderers, material, true);
+}
+
+Material * Graphics::getGBufferMaterial() const
+{
+	return MaterialStore::getInstance().findMaterialVariant("gbuffer", ShaderDefines().set("MULTI_DRAW", multiDrawIndirect));
+}
+
+void Graphics::uploadGBuffer(const Material * material) const
+{
+	// Attachment i is bound to image unit i.
+	for (unsigned int i = 0; i < 5; ++i) {
+		glUniform1i(material->getUniformLocation(G_BUFFER_NAMES[i]), i);
+		if (!deferredShading) continue;
+		glBindImageTexture(i, gBuffer->GetColorBuffer(i), 0, GL_FALSE, 0, GL_READ_ONLY, i == 0 ? GL_RGBA32F : GL_RGBA16F);
+	}
+}
+
+void Graphics::renderIndirectDiffuse(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight)
+{
+	const bool temporal = temporalIndirectDiffuse;
+	const Material * material = getVoxelConeTracingMaterial(temporal ? TRACE_TEMPORAL : TRACE_DOWNSAMPLED);
+	const unsigned int downsampling = std::min(indirectDiffuseDownsampling, 4);
+	const unsigned int width = (viewportWidth + downsampling - 1) / downsampling;
+	const unsigned int height = (viewportHeight + downsampling - 1) / downsampling;
+
+	// The buffer of the previous frame becomes the history.
+	if (temporal) std::swap(indirectDiffuseFBO, indirectDiffuseHistoryFBO);
+
+	// (Re)allocate the downsampled buffers if the viewport or the downsampling has changed.
+	for (FBO ** fbo : { &indirectDiffuseFBO, &indirectDiffuseHistoryFBO }) {
+		if (fbo == &indirectDiffuseHistoryFBO && !temporal) continue;
+		if (*fbo != nullptr && (*fbo)->width == width && (*fbo)->height == height) continue;
+		if (*fbo) delete *fbo;
+		*fbo = new FBO(width, height, GL_NEAREST, GL_NEAREST, GL_RGBA16F, GL_FLOAT, GL_CLAMP_TO_EDGE);
+		(*fbo)->AddColorAttachment(GL_RGBA16F, GL_FLOAT);
+		temporalHistory = false;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, indirectDiffuseFBO->frameBuffer);
+	glUseProgram(material->program);
+
+	// GL Settings. Texels without geometry are cleared to a zero normal, so they are never upsampled from.
+	glViewport(0, 0, width, height);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+	glDisable(GL_BLEND);
+
+	// Upload uniforms.
+	uploadGlobalConstants(material, width, height);
+	uploadVoxelStorage(material);
+	uploadIndirectDiffuse(material, temporal ? TRACE_TEMPORAL : TRACE_DOWNSAMPLED);
+	uploadGBuffer(material);
+
+	// Render.
+	renderConeTracedSurfaces(renderingScene, material);
+
+	// Remember the camera, so that the next frame can reproject this one.
+	auto & camera = *renderingScene.renderingCamera;
+	previousViewProjection = camera.getProjectionMatrix() * camera.viewMatrix;
+	previousCameraPosition = camera.position;
+	temporalHistory = temporal;
+	++temporalFrame;
+}
+
+void Graphics::uploadVoxelStorage(const Material * material) const
+{
+	glUniform1i(material->getUniformLocation(VOXEL_STORAGE_NAME), voxelStorage);
+	voxelTexture->Activate(material, "texture3D", 0);
+
+	// Voxel size (half the edge of a voxel, i.e. relative to the unity cube).
+	float voxelSize = 1.0f / voxelTexture->width;
+	if (voxelStorage == VoxelStorage::SPARSE_VOXEL_OCTREE) voxelSize = 1.0f / (1 << octreeLevels);
+	if (voxelStorage == VoxelStorage::CLIPMAP) voxelSize = 0.5f * getClipmapVoxelSize(0);
+	glUniform1f(material->getUniformLocation(VOXEL_SIZE_NAME), voxelSize);
+
+	// Sparse voxel octree.
+	glUniform1i(material->getUniformLocation(OCTREE_LEVELS_NAME), octreeLevels);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, octreeNodeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, octreeBrickBuffer);
+
+	// Anisotropic voxels (see getVoxelConeTracingMaterial). Direction i uses texture unit 9 + i, after the clipmap cascades.
+	const bool anisotropic = voxelStorage == VoxelStorage::DENSE_TEXTURE && !anisotropicVoxelTextures.empty();
+	for (unsigned int i = 0; anisotropic && i < anisotropicVoxelTextures.size(); ++i) {
+		anisotropicVoxelTextures[i]->Activate(material, ANISOTROPIC_VOXEL_TEXTURES_NAME + ("[" + std::to_string(i) + "]"), 9 + i);
+	}
+
+	// Clipmap. Cascade i uses texture unit 3 + i, since units 0 to 2 are used by the voxel texture and the visualization.
+	if (voxelStorage == VoxelStorage::CLIPMAP) {
+		glUniform1i(material->getUniformLocation(CLIPMAP_CASCADES_NAME), clipmapTextures.size());
+		for (unsigned int i = 0; i < clipmapTextures.size(); ++i) {
+			const float extent = 0.5f * clipmapTextures[i]->width * getClipmapVoxelSize(i);
+			const glm::vec3 center = getClipmapVoxelSize(i) * glm::vec3(clipmapOrigins[i]) + extent;
+			const std::string index = "[" + std::to_string(i) + "]";
+			glUniform4fv(material->getUniformLocation(CLIPMAP_REGIONS_NAME + index), 1, glm::value_ptr(glm::vec4(center, extent)));
+			clipmapTextures[i]->Activate(material, CLIPMAP_NAME + index, 3 + i);
+		}
+	}
 }
 
-void Graphics::uploadCamera(Camera & camera, const GLuint program)
+void Graphics::uploadIndirectDiffuse(const Material * material, IndirectDiffuseMode mode) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(program, VIEW_MATRIX_NAME), 1, GL_FALSE, glm::value_ptr(camera.viewMatrix));
-	glUniformMatrix4fv(glGetUniformLocation(program, PROJECTION_MATRIX_NAME), 1, GL_FALSE, glm::value_ptr(camera.getProjectionMatrix()));
-	glUniform3fv(glGetUniformLocation(program, CAMERA_POSITION_NAME), 1, glm::value_ptr(camera.position));
+	// Units 1 and 2 are only used by the voxelization visualization. The samplers are assigned to them even if nothing
+	// is upsampled, since samplers of different types may not use the same unit (i.e. that of texture3D).
+	glUniform1i(material->getUniformLocation(INDIRECT_DIFFUSE_BUFFER_NAME), 1);
+	glUniform1i(material->getUniformLocation(INDIRECT_DIFFUSE_GEOMETRY_NAME), 2);
+	if (mode == UPSAMPLE) {
+		indirectDiffuseFBO->ActivateAsTexture(material, INDIRECT_DIFFUSE_BUFFER_NAME, 1, 0);
+		indirectDiffuseFBO->ActivateAsTexture(material, INDIRECT_DIFFUSE_GEOMETRY_NAME, 2, 1);
+	}
+	else if (mode == TRACE_TEMPORAL) {
+		// The same samplers read the history, which is reprojected using the previous camera.
+		indirectDiffuseHistoryFBO->ActivateAsTexture(material, INDIRECT_DIFFUSE_BUFFER_NAME, 1, 0);
+		indirectDiffuseHistoryFBO->ActivateAsTexture(material, INDIRECT_DIFFUSE_GEOMETRY_NAME, 2, 1);
+		glUniform1i(material->getUniformLocation(TEMPORAL_HISTORY_NAME), temporalHistory);
+		glUniform1i(material->getUniformLocation(TEMPORAL_FRAME_NAME), temporalFrame);
+		glUniformMatrix4fv(material->getUniformLocation(PREVIOUS_VIEW_PROJECTION_NAME), 1, GL_FALSE, glm::value_ptr(previousViewProjection));
+		glUniform3fv(material->getUniformLocation(PREVIOUS_CAMERA_POSITION_NAME), 1, glm::value_ptr(previousCameraPosition));
+	}
+	else for (int unit = 1; unit <= 2; ++unit) {
+		// The downsampled buffer must not be bound while it's rendered to.
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
 }
 
-void Graphics::renderQueue(RenderingQueue renderingQueue, const GLuint program, bool uploadMaterialSettings) const
+void Graphics::uploadGlobalConstants(const Material * material, unsigned int viewportWidth, unsigned int viewportHeight) const
 {
-	for (unsigned int i = 0; i < renderingQueue.size(); ++i) if (renderingQueue[i]->enabled)
-		renderingQueue[i]->transform.updateTransformMatrix();
+	glm::vec2 screenSize(viewportWidth, viewportHeight);
+	glUniform2fv(material->getUniformLocation(SCREEN_SIZE_NAME), 1, glm::value_ptr(screenSize));
+}
+
+void Graphics::renderQueue(RenderingQueue renderingQueue, const Material * material, bool bindMaterialSettings, float maxError)
+{
+	if (multiDrawIndirect) {
+		renderQueueIndirect(renderingQueue, material, maxError);
+		return;
+	}
 
 	for (unsigned int i = 0; i < renderingQueue.size(); ++i) if (renderingQueue[i]->enabled) {
-		if (uploadMaterialSettings && renderingQueue[i]->materialSetting != nullptr) {
-			renderingQueue[i]->materialSetting->Upload(program, false);
+		// All material settings have been uploaded by uploadUniformBuffers, so drawing only selects one of them.
+		const GLuint index = getRendererIndex(renderingQueue[i]);
+		if (bindMaterialSettings) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BINDING, materialUniformBuffer, index * materialBlockStride, sizeof(MaterialBlock));
 		}
-		renderingQueue[i]->render(program);
+		const glm::mat4 & M = getWorldMatrix(renderingQueue[i]);
+		renderingQueue[i]->render(material, M, getLevelOfDetail(renderingQueue[i], M, maxError));
 	}
 }
 
+unsigned int Graphics::getLevelOfDetail(const MeshRenderer * renderer, const glm::mat4 & M, float maxError)
+{
+	// The error is scaled to model space using the largest scale of the transform, i.e. it's conservative.
+	if (maxError <= 0.0f) return 0;
+	const float scale = std::max(glm::length(glm::vec3(M[0])), std::max(glm::length(glm::vec3(M[1])), glm::length(glm::vec3(M[2]))));
+	return scale > 0.0f ? renderer->mesh->getLevelOfDetail(maxError / scale) : 0;
+}
+
+// ----------------------
+// Renderers.
+// ----------------------
+void Graphics::updateRenderers(Scene & renderingScene)
+{
+	// Transforms are only recalculated if they have changed (see Transform::getTransformMatrix).
+	// Meshes are only re-uploaded if their vertex format has changed.
+	const auto & renderers = renderingScene.renderers;
+	rendererIndices.clear();
+	worldMatrices.resize(renderers.size() + 1);
+	worldMatrices[0] = glm::mat4(1.0f);
+	for (unsigned int i = 0; i < renderers.size(); ++i) {
+		rendererIndices[renderers[i]] = i + 1;
+		worldMatrices[i + 1] = renderers[i]->transform.getTransformMatrix();
+		renderers[i]->setPackedVertexData(packedVertexData);
+	}
+}
+
+GLuint Graphics::getRendererIndex(const MeshRenderer * renderer) const
+{
+	const auto index = rendererIndices.find(renderer);
+	return index != rendererIndices.end() ? index->second : 0;
+}
+
+const glm::mat4 & Graphics::getWorldMatrix(MeshRenderer * renderer)
+{
+	const GLuint index = getRendererIndex(renderer);
+	return index > 0 ? worldMatrices[index] : renderer->transform.getTransformMatrix();
+}
+
+// ----------------------
+// Multi-draw indirect.
+// ----------------------
+void Graphics::renderQueueIndirect(RenderingQueue renderingQueue, const Material * material, float maxError)
+{
+	if (drawStorageBuffer == 0) {
+		glGenBuffers(1, &drawStorageBuffer);
+		glGenBuffers(1, &drawCommandBuffer);
+	}
+
+	// Every enabled renderer is a draw. Static meshes are drawn from the batch, using the draw index as base instance.
+	// The batch only contains packed vertices, so static meshes that aren't packed are drawn like dynamic ones.
+	drawBlocks.clear();
+	drawCommands.clear();
+	for (auto * renderer : renderingQueue) if (renderer->enabled) {
+		const GLuint drawIndex = drawBlocks.size();
+		const glm::mat4 & M = getWorldMatrix(renderer);
+		drawBlocks.push_back({ M * renderer->mesh->dequantizationMatrix, getRendererIndex(renderer), { 0, 0, 0 } });
+		if (!isBatched(renderer->mesh)) continue;
+		const MeshBatch::Range & range = meshBatch.getRange(renderer->mesh, getLevelOfDetail(renderer, M, maxError));
+		drawCommands.push_back({ range.count, 1, range.firstIndex, range.baseVertex, drawIndex });
+	}
+	if (drawBlocks.empty()) return;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawStorageBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, drawBlocks.size() * sizeof(DrawBlock), drawBlocks.data(), GL_STREAM_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, drawStorageBuffer);
+
+	if (!drawCommands.empty()) {
+		meshBatch.bind(drawBlocks.size());
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCommands.size() * sizeof(DrawElementsIndirectCommand), drawCommands.data(), GL_STREAM_DRAW);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, drawCommands.size(), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	// Other meshes use their own buffers. Their vertex arrays don't have a draw index, so it's a constant attribute.
+	for (GLuint i = 0, drawIndex = 0; i < renderingQueue.size(); ++i) if (renderingQueue[i]->enabled) {
+		if (!isBatched(renderingQueue[i]->mesh)) {
+			const glm::mat4 & M = getWorldMatrix(renderingQueue[i]);
+			glVertexAttribI1ui(2, drawIndex);
+			renderingQueue[i]->render(material, M, getLevelOfDetail(renderingQueue[i], M, maxError));
+		}
+		++drawIndex;
+	}
+}
+
+bool Graphics::isBatched(const Mesh * mesh)
+{
+	return mesh->staticMesh && mesh->packedVertexData;
+}
+
+// ----------------------
+// Uniform buffers.
+// ----------------------
+void Graphics::initUniformBuffers()
+{
+	GLint alignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	materialBlockStride = (sizeof(MaterialBlock) + alignment - 1) / alignment * alignment;
+	glGenBuffers(1, &frameUniformBuffer);
+	glGenBuffers(1, &lightsUniformBuffer);
+	glGenBuffers(1, &materialUniformBuffer);
+	glGenBuffers(1, &materialStorageBuffer);
+}
+
+void Graphics::uploadUniformBuffers(Scene & renderingScene)
+{
+	// Frame.
+	const Camera & camera = *renderingScene.renderingCamera;
+	const FrameBlock frame = { camera.viewMatrix, camera.getProjectionMatrix(), camera.position, Application::getInstance().state };
+	glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), &frame, GL_STREAM_DRAW);
+
+	// Lights. The number of lights (padded to 16 bytes) is followed by the array, which has room for at least maxLights lights.
+	const auto & pointLights = renderingScene.pointLights;
+	const GLint numberOfLights = pointLights.size();
+	std::vector<PointLightBlock> lights(std::max<size_t>(std::max(maxLights, 1), pointLights.size()));
+	for (unsigned int i = 0; i < pointLights.size(); ++i) {
+		lights[i] = { glm::vec4(pointLights[i].position, 1.0f), glm::vec4(pointLights[i].color, 1.0f) };
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, lightsUniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::vec4) + lights.size() * sizeof(PointLightBlock), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GLint), &numberOfLights);
+	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::vec4), lights.size() * sizeof(PointLightBlock), lights.data());
+
+	// Material settings. Block 0 is the default setting, followed by one block per renderer (see rendererIndices).
+	// The uniform buffer is bound one block at a time, while multi-draws index the storage buffer (see renderQueueIndirect).
+	const auto & renderers = renderingScene.renderers;
+	std::vector<MaterialBlock> blocks(renderers.size() + 1);
+	std::vector<unsigned char> materials(blocks.size() * materialBlockStride);
+	for (unsigned int i = 0; i <= renderers.size(); ++i) {
+		const MaterialSetting setting = i > 0 && renderers[i - 1]->materialSetting ? *renderers[i - 1]->materialSetting : MaterialSetting();
+		blocks[i] = {
+			setting.diffuseColor, setting.diffuseReflectivity, setting.specularColor, setting.specularDiffusion,
+			setting.specularReflectivity, setting.emissivity, setting.refractiveIndex, setting.transparency
+		};
+		std::memcpy(&materials[i * materialBlockStride], &blocks[i], sizeof(MaterialBlock));
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, materialUniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, materials.size(), materials.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialStorageBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, blocks.size() * sizeof(MaterialBlock), blocks.data(), GL_STREAM_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, materialStorageBuffer);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, frameUniformBuffer);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTS_BINDING, lightsUniformBuffer);
+	glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BINDING, materialUniformBuffer, 0, sizeof(MaterialBlock));
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 // ----------------------
 // Voxelization.
 // ----------------------
 void Graphics::initVoxelization()
 {
-	voxelizationMaterial = MaterialStore::getInstance().findMaterialWithName("voxelization");
+	averageVoxelsMaterial = MaterialStore::getInstance().findMaterialWithName("average_voxels");
+	mipmapMaterial = MaterialStore::getInstance().findMaterialWithName("mipmap");
+	anisotropicMipmapMaterial = MaterialStore::getInstance().findMaterialWithName("anisotropic_mipmap");
 
-	assert(voxelizationMaterial != nullptr);
+	assert(averageVoxelsMaterial != nullptr);
+	assert(mipmapMaterial != nullptr);
+	assert(anisotropicMipmapMaterial != nullptr);
 
-	const std::vector<GLfloat> texture3D(4 * voxelTextureSize * voxelTextureSize * voxelTextureSize, 0.0f);
-	voxelTexture = new Texture3D(texture3D, voxelTextureSize, voxelTextureSize, voxelTextureSize, true);
+	initVoxelTexture();
+}
+
+void Graphics::initVoxelTexture()
+{
+	// Round up to the closest supported power of 2.
+	int size = 2;
+	while (size < voxelTextureSize && size < 1024) size *= 2;
+	voxelTextureSize = size;
+
+	if (voxelTexture) delete voxelTexture;
+	voxelTexture = new Texture3D(std::vector<GLfloat>(), size, size, size, true);
+
+	for (auto * texture : surfaceVoxelTextures) delete texture;
+	surfaceVoxelTextures.clear();
+	for (unsigned int i = 0; voxelLightInjection && i < 3; ++i) surfaceVoxelTextures.push_back(new Texture3D(std::vector<GLfloat>(), size, size, size, false));
+	injectedPointLights.clear();
+
+	for (auto * texture : staticVoxelTextures) delete texture;
+	staticVoxelTextures.clear();
+	for (unsigned int i = 0; i < getVoxelizationTargets().size(); ++i) staticVoxelTextures.push_back(new Texture3D(std::vector<GLfloat>(), size, size, size, false));
+	staticVoxelizationQueued = true;
+}
+
+std::vector<Texture3D*> Graphics::getVoxelizationTargets() const
+{
+	return voxelLightInjection ? surfaceVoxelTextures : std::vector<Texture3D*>{ voxelTexture };
 }
 
 void Graphics::voxelize(Scene & renderingScene, bool clearVoxelization)
 {
-	if (clearVoxelization) {
-		GLfloat clearColor[4] = { 0, 0, 0, 0 };
-		voxelTexture->Clear(clearColor);
+	if (voxelizationValidationQueued && (voxelStorage != VoxelStorage::DENSE_TEXTURE || cpuVoxelization || voxelLightInjection)) {
+		std::cerr << "Voxelization validation requires GPU voxelization into the dense voxel texture without light injection." << std::endl;
+		voxelizationValidationQueued = false;
+	}
+	if (sparseVoxelOctreeValidationQueued && (voxelStorage != VoxelStorage::SPARSE_VOXEL_OCTREE || cpuVoxelization)) {
+		std::cerr << "Sparse voxel octree validation requires the sparse voxel octree storage and GPU voxelization." << std::endl;
+		sparseVoxelOctreeValidationQueued = false;
 	}
 
-	Material * material = voxelizationMaterial;
+	if (voxelStorage == VoxelStorage::SPARSE_VOXEL_OCTREE) {
+		buildSparseVoxelOctree(renderingScene);
+		return;
+	}
+
+	if (cpuVoxelization) {
+		voxelizeOnCPU(renderingScene);
+		return;
+	}
+
+	bool updated = true;
+	glm::ivec3 updateMin(0), updateMax(voxelTexture->width);
+	if (incrementalVoxelization) {
+		updated = voxelizeIncrementally(renderingScene, updateMin, updateMax);
+	}
+	else {
+		if (clearVoxelization) {
+			GLfloat clearColor[4] = { 0, 0, 0, 0 };
+			for (auto * texture : getVoxelizationTargets()) texture->Clear(clearColor);
+		}
+
+		// Render.
+		renderVoxelizationPass(renderingScene.renderers, VoxelGrid(voxelTexture->width), getVoxelizationTargets());
+	}
+
+	// Light the voxels that have been voxelized, or all of them if the lights have changed.
+	if (voxelLightInjection) {
+		if (pointLightsChanged(renderingScene.pointLights, injectedPointLights)) {
+			updated = true;
+			updateMin = glm::ivec3(0);
+			updateMax = glm::ivec3(voxelTexture->width);
+		}
+		if (updated) injectLight(renderingScene, updateMin, updateMax);
+	}
+
+	if (voxelizationValidationQueued) validateVoxelization(renderingScene);
+
+	if (regenerateMipmapQueued) generateVoxelMipmaps();
+	else if (updated && automaticallyRegenerateMipmap) generateVoxelMipmaps(updateMin, updateMax);
+}
+
+void Graphics::renderVoxelizationPass(
+	RenderingQueue renderers, const VoxelGrid & grid, const std::vector<Texture3D*> & targets,
+	StaticLayerAccumulation staticLayer)
+{
+	const Material * material = getLightingMaterial("voxelization", ShaderDefines().set("MULTI_DRAW", multiDrawIndirect));
+	const bool fragmentList = targets.empty();
+	const GLuint numberOfLayers = targets.size();
+	assert(numberOfLayers <= 3);
+	const bool average = averageVoxelFragments && !fragmentList
+		&& reserveVoxelAccumulationBuffers(grid.size, numberOfLayers, staticLayer != IGNORE_STATIC_LAYER);
 
 	glUseProgram(material->program);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+	// Output. Target i is bound to image unit i.
+	for (unsigned int i = 0; i < numberOfLayers; ++i) {
+		glUniform1i(material->getUniformLocation(VOXEL_LAYER_NAMES[i]), i);
+		glBindImageTexture(i, targets[i]->textureID, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	}
+	if (average) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, voxelAccumulationBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, staticVoxelAccumulationBuffer);
+	}
+
 	// Settings.
-	glViewport(0, 0, voxelTextureSize, voxelTextureSize);
+	glViewport(0, 0, grid.size, grid.size);
 	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 	glDisable(GL_CULL_FACE);
 	glDisable(GL_DEPTH_TEST);
 	glDisable(GL_BLEND);
 
-	// Texture.
-	voxelTexture->Activate(material->program, "texture3D", 0);
-	glBindImageTexture(0, voxelTexture->textureID, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	// Rasterization mode and output.
+	glUniform1i(material->getUniformLocation(CONSERVATIVE_VOXELIZATION_NAME), conservativeVoxelization);
+	glUniform1i(material->getUniformLocation(FRAGMENT_LIST_NAME), fragmentList);
+	glUniform1i(material->getUniformLocation(AVERAGE_VOXEL_FRAGMENTS_NAME), average);
+	glUniform1i(material->getUniformLocation(LIGHT_INJECTION_NAME), numberOfLayers == 3);
 
-	// Lighting.
-	uploadLighting(renderingScene, material->program);
+	// Voxel grid.
+	glUniform1i(material->getUniformLocation(VOXEL_GRID_SIZE_NAME), grid.size);
+	glUniform4fv(material->getUniformLocation(VOXEL_GRID_REGION_NAME), 1, glm::value_ptr(glm::vec4(grid.center, grid.extent)));
+	glUniform1i(material->getUniformLocation(TOROIDAL_NAME), grid.toroidal);
+	glUniform3iv(material->getUniformLocation(UPDATE_MIN_NAME), 1, glm::value_ptr(grid.updateMin));
+	glUniform3iv(material->getUniformLocation(UPDATE_MAX_NAME), 1, glm::value_ptr(grid.updateMax));
 
-	// Render.
-	renderQueue(renderingScene.renderers, material->program, true);
+	// Render. A level of detail is only used if its error is small relative to a voxel.
+	const float voxelSize = 2.0f * grid.extent / grid.size;
+	renderQueue(renderers, material, true, voxelizationLevelOfDetail * voxelSize);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	// Write the averages to the target.
+	if (average) {
+		const Material * resolveMaterial = averageVoxelsMaterial;
+		const glm::ivec3 groups = (grid.updateMax - grid.updateMin + 3) / 4;
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		glUseProgram(resolveMaterial->program);
+		glUniform1i(resolveMaterial->getUniformLocation(VOXEL_GRID_SIZE_NAME), grid.size);
+		glUniform1i(resolveMaterial->getUniformLocation(STATIC_LAYER_NAME), staticLayer);
+		glUniform1i(resolveMaterial->getUniformLocation(NUMBER_OF_LAYERS_NAME), numberOfLayers);
+		for (unsigned int i = 0; i < numberOfLayers; ++i) glUniform1i(resolveMaterial->getUniformLocation(VOXEL_LAYER_NAMES[i]), i);
+		glUniform3iv(resolveMaterial->getUniformLocation(UPDATE_MIN_NAME), 1, glm::value_ptr(grid.updateMin));
+		glUniform3iv(resolveMaterial->getUniformLocation(UPDATE_MAX_NAME), 1, glm::value_ptr(grid.updateMax));
+		glDispatchCompute(groups.x, groups.y, groups.z);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+	}
+}
+
+bool Graphics::reserveVoxelAccumulationBuffers(GLuint size, GLuint numberOfLayers, bool staticLayer)
+{
+	const GLsizeiptr bufferSize = GLsizeiptr(1 + 2 * numberOfLayers) * sizeof(GLuint) * size * size * size;
+	const GLsizeiptr memory = (staticLayer ? 2 : 1) * bufferSize;
+	if (memory > MAX_VOXEL_ACCUMULATION_MEMORY) {
+		if (rejectedVoxelAccumulationMemory != memory) {
+			std::cerr << "Averaging voxel fragments at " << size << "^3 would need " << (memory >> 20) << " MB (at most "
+				<< (MAX_VOXEL_ACCUMULATION_MEMORY >> 20) << " MB), so an arbitrary fragment is kept per voxel." << std::endl;
+		}
+		rejectedVoxelAccumulationMemory = memory;
+		return false;
+	}
+
+	// The accumulation buffers are all zeros between passes, since resolving them clears them.
+	const auto allocate = [](GLuint & buffer, GLsizeiptr & allocatedSize, GLsizeiptr size) {
+		if (buffer == 0) glGenBuffers(1, &buffer);
+		if (allocatedSize == size) return;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+		if (size > 0) glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		allocatedSize = size;
+	};
+	allocate(voxelAccumulationBuffer, voxelAccumulationBufferSize, bufferSize);
+	if (staticLayer) allocate(staticVoxelAccumulationBuffer, staticVoxelAccumulationBufferSize, bufferSize);
+
+	bool outOfMemory = false;
+	for (GLenum error = glGetError(); error != GL_NO_ERROR; error = glGetError()) outOfMemory = outOfMemory || error == GL_OUT_OF_MEMORY;
+	if (outOfMemory) {
+		std::cerr << "Could not allocate " << (memory >> 20) << " MB for averaging voxel fragments at " << size << "^3, so an arbitrary fragment is kept per voxel." << std::endl;
+		allocate(voxelAccumulationBuffer, voxelAccumulationBufferSize, 0);
+		allocate(staticVoxelAccumulationBuffer, staticVoxelAccumulationBufferSize, 0);
+		rejectedVoxelAccumulationMemory = memory;
+		return false;
+	}
+	rejectedVoxelAccumulationMemory = 0;
+	return true;
+}
+
+void Graphics::voxelizeOnCPU(Scene & renderingScene)
+{
+	cpuVoxelizer.voxelTextureSize = voxelTexture->width;
+	cpuVoxelizer.voxelize(renderingScene);
+	voxelTexture->Upload(cpuVoxelizer.voxels);
+
+	// The mipmap is built on the CPU as well (using the same filter as mipmap.comp).
 	if (automaticallyRegenerateMipmap || regenerateMipmapQueued) {
-		glGenerateMipmap(GL_TEXTURE_3D);
+		cpuVoxelMipmap.build(cpuVoxelizer.voxels, voxelTexture->width);
+		for (unsigned int level = 1; level < cpuVoxelMipmap.levels.size(); ++level) voxelTexture->Upload(cpuVoxelMipmap.levels[level], level);
+		buildAnisotropicMipmap(glm::ivec3(0), glm::ivec3(voxelTexture->width));
 		regenerateMipmapQueued = false;
 	}
-	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void Graphics::validateVoxelization(Scene & renderingScene)
+{
+	voxelizationValidationQueued = false;
+	const int size = voxelTexture->width;
+	std::vector<unsigned char> voxels(4 * size_t(size) * size * size);
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+	glBindTexture(GL_TEXTURE_3D, voxelTexture->textureID);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_3D, 0, GL_RGBA, GL_UNSIGNED_BYTE, voxels.data());
+
+	cpuVoxelizer.voxelTextureSize = size;
+	cpuVoxelizer.voxelize(renderingScene);
+
+	// Voxels are compared by coverage (alpha > 0), and the colors of voxels that both cover.
+	unsigned int gpuOnly = 0, cpuOnly = 0, both = 0, maxDifference = 0;
+	double totalDifference = 0;
+	for (size_t i = 0; i < voxels.size(); i += 4) {
+		const bool gpu = voxels[i + 3] > 0, cpu = cpuVoxelizer.voxels[i + 3] > 0;
+		if (gpu != cpu) {
+			++(gpu ? gpuOnly : cpuOnly);
+			continue;
+		}
+		if (!gpu) continue;
+		++both;
+		for (unsigned int k = 0; k < 4; ++k) {
+			const unsigned int difference = std::abs(int(voxels[i + k]) - int(cpuVoxelizer.voxels[i + k]));
+			maxDifference = std::max(maxDifference, difference);
+			totalDifference += difference;
+		}
+	}
+	std::cout << "- Voxelization validation (" << size << "^3): " << both << " voxels in both, "
+		<< gpuOnly << " only on the GPU, " << cpuOnly << " only on the CPU. Color difference: max "
+		<< maxDifference << "/255, mean " << (both > 0 ? totalDifference / (4.0 * both) : 0.0) << "/255." << std::endl;
+	if (conservativeVoxelization || voxelizationLevelOfDetail > 0) {
+		std::cout << "  (The CPU reference rasterizes full detail meshes at voxel centers, so conservative voxelization and levels of detail add differences.)" << std::endl;
+	}
+}
+
+// ----------------------
+// Light injection.
+// ----------------------
+void Graphics::injectLight(Scene & renderingScene, glm::ivec3 updateMin, glm::ivec3 updateMax)
+{
+	const Material * material = getLightingMaterial("inject_light");
+	const glm::ivec3 groups = (updateMax - updateMin + 3) / 4;
+	const int size = voxelTexture->width;
+
+	glUseProgram(material->program);
+	glUniform1i(material->getUniformLocation(VOXEL_GRID_SIZE_NAME), size);
+	glUniform4fv(material->getUniformLocation(VOXEL_GRID_REGION_NAME), 1, glm::value_ptr(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+	glUniform3iv(material->getUniformLocation(UPDATE_MIN_NAME), 1, glm::value_ptr(updateMin));
+	glUniform3iv(material->getUniformLocation(UPDATE_MAX_NAME), 1, glm::value_ptr(updateMax));
+
+	// The voxel texture is bound to image unit 0 and the surface volumes to units 1 to 3.
+	const char * sources[3] = { ALBEDO_VOLUME_NAME, VOXEL_LAYER_NAMES[1], VOXEL_LAYER_NAMES[2] };
+	glUniform1i(material->getUniformLocation(VOXEL_LAYER_NAMES[0]), 0);
+	glBindImageTexture(0, voxelTexture->textureID, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	for (unsigned int i = 0; i < 3; ++i) {
+		glUniform1i(material->getUniformLocation(sources[i]), 1 + i);
+		glBindImageTexture(1 + i, surfaceVoxelTextures[i]->textureID, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA8);
+	}
+
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	glDispatchCompute(groups.x, groups.y, groups.z);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+	injectedPointLights = renderingScene.pointLights;
+}
+
+// ----------------------
+// Voxel mipmapping.
+// ----------------------
+void Graphics::generateVoxelMipmaps(glm::ivec3 regionMin, glm::ivec3 regionMax)
+{
+	if (glm::any(glm::greaterThanEqual(regionMin, regionMax))) return;
+
+	// The isotropic mipmap is also used by the voxelization visualization.
+	if (computeShaderMipmaps) {
+		buildMipmap(voxelTexture, regionMin, regionMax);
+	}
+	else {
+		glBindTexture(GL_TEXTURE_3D, voxelTexture->textureID);
+		glGenerateMipmap(GL_TEXTURE_3D);
+	}
+	buildAnisotropicMipmap(regionMin, regionMax);
+	regenerateMipmapQueued = false;
+}
+
+void Graphics::buildMipmap(Texture3D * texture, glm::ivec3 regionMin, glm::ivec3 regionMax)
+{
+	const Material * material = mipmapMaterial;
+	const int BLOCK_SIZE = 1 << VoxelMipmap::LEVELS_PER_PASS; // Must match mipmap.comp.
+	int numberOfLevels = 1;
+	while ((texture->width >> numberOfLevels) > 0) ++numberOfLevels;
+
+	glUseProgram(material->program);
+	texture->Activate(material, MIPMAP_SOURCE_NAME, 0);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	// Every dispatch builds up to 3 levels from the last level of the previous dispatch.
+	for (int sourceLevel = 0; sourceLevel + 1 < numberOfLevels; sourceLevel += VoxelMipmap::LEVELS_PER_PASS) {
+		const int levels = std::min<int>(VoxelMipmap::LEVELS_PER_PASS, numberOfLevels - 1 - sourceLevel);
+		glUniform1i(material->getUniformLocation(MIPMAP_SOURCE_LEVEL_NAME), sourceLevel);
+		glUniform1i(material->getUniformLocation(MIPMAP_LEVELS_NAME), levels);
+		for (int i = 0; i < levels; ++i) {
+			glBindImageTexture(1 + i, texture->textureID, sourceLevel + 1 + i, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+			glUniform1i(material->getUniformLocation(MIPMAP_DESTINATION_NAME + std::to_string(1 + i)), 1 + i);
+		}
+
+		// Only dispatch the blocks that cover the region.
+		const glm::ivec3 first = (regionMin >> sourceLevel) / BLOCK_SIZE;
+		const glm::ivec3 last = ((regionMax - 1) >> sourceLevel) / BLOCK_SIZE;
+		glUniform3iv(material->getUniformLocation(MIPMAP_OFFSET_NAME), 1, glm::value_ptr(first));
+		glDispatchCompute(last.x - first.x + 1, last.y - first.y + 1, last.z - first.z + 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+}
+
+void Graphics::buildAnisotropicMipmap(glm::ivec3 regionMin, glm::ivec3 regionMax)
+{
+	if (!anisotropicVoxels) return;
+
+	// (Re)allocate the directional volumes.
+	const int size = std::max(voxelTexture->width / 2, 1);
+	if (anisotropicVoxelTextures.empty() || anisotropicVoxelTextures[0]->width != size) {
+		for (auto * texture : anisotropicVoxelTextures) delete texture;
+		anisotropicVoxelTextures.clear();
+		for (unsigned int i = 0; i < 6; ++i) anisotropicVoxelTextures.push_back(new Texture3D(std::vector<GLfloat>(), size, size, size, false));
+		regionMin = glm::ivec3(0);
+		regionMax = glm::ivec3(voxelTexture->width);
+	}
+
+	// Build every level from the previous one. The first level is built from level 0 of the voxel texture.
+	const Material * material = anisotropicMipmapMaterial;
+	glUseProgram(material->program);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	for (int level = 0; (size >> level) > 0; ++level) {
+		const glm::ivec3 first = regionMin >> (level + 1), last = (regionMax - 1) >> (level + 1);
+		const glm::ivec3 groups = (last - first) / 4 + 1;
+		glUniform3iv(material->getUniformLocation(MIPMAP_OFFSET_NAME), 1, glm::value_ptr(first));
+		for (int direction = 0; direction < 6; ++direction) {
+			Texture3D * source = level == 0 ? voxelTexture : anisotropicVoxelTextures[direction];
+			source->Activate(material, MIPMAP_SOURCE_NAME, 0);
+			glUniform1i(material->getUniformLocation(MIPMAP_SOURCE_LEVEL_NAME), std::max(level - 1, 0));
+			glUniform1i(material->getUniformLocation(MIPMAP_DIRECTION_NAME), direction);
+			glBindImageTexture(0, anisotropicVoxelTextures[direction]->textureID, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+			glDispatchCompute(groups.x, groups.y, groups.z);
+		}
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+}
+
+// ----------------------
+// Incremental voxelization.
+// ----------------------
+bool Graphics::voxelizeIncrementally(Scene & renderingScene, glm::ivec3 & updateMin, glm::ivec3 & updateMax)
+{
+	auto & renderers = renderingScene.renderers;
+	const auto isIn = [](const std::vector<MeshRenderer*> & queue, MeshRenderer * renderer) {
+		return std::find(queue.begin(), queue.end(), renderer) != queue.end();
+	};
+
+	// The static layer has to be rebaked if the scene or the voxelization settings have changed,
+	// or if the lights have changed and they are not injected separately.
+	bool rebake = staticVoxelizationQueued || renderers != bakedRenderers;
+	rebake = rebake || conservativeVoxelization != bakedConservatively || averageVoxelFragments != bakedAveraged;
+	rebake = rebake || voxelizationLevelOfDetail != bakedLevelOfDetail;
+	rebake = rebake || (!voxelLightInjection && pointLightsChanged(renderingScene.pointLights, bakedPointLights));
+
+	// Static renderers that have changed become dynamic, and are removed from the static layer.
+	bool dynamicRenderersChanged = false;
+	for (auto * renderer : renderers) {
+		renderer->updateDirtyState();
+		if (!renderer->dirty) continue;
+		if (isIn(dynamicRenderers, renderer)) {
+			dynamicRenderersChanged = true;
+		}
+		else if (isIn(staticRenderers, renderer)) {
+			dynamicRenderers.push_back(renderer);
+			rebake = true;
+		}
+	}
+	if (!rebake && !dynamicRenderersChanged) return false; // Nothing has changed since the last voxelization.
+
+	if (rebake) {
+		dynamicRenderers.erase(std::remove_if(dynamicRenderers.begin(), dynamicRenderers.end(), [&](MeshRenderer * renderer) {
+			return !isIn(renderers, renderer);
+		}), dynamicRenderers.end());
+		voxelizedBounds.clear();
+	}
+
+	// Find the part of the voxel texture that has to be updated, i.e. where the changed dynamic renderers were and are now.
+	// (The renderers that just became dynamic are part of the static layer, so they are covered by rebaking it.)
+	const int size = voxelTexture->width;
+	const auto toVoxel = [size](glm::vec3 p) { return glm::ivec3(glm::floor((p + 1.0f) * 0.5f * float(size))); };
+	updateMin = glm::ivec3(rebake ? 0 : size);
+	updateMax = glm::ivec3(rebake ? size : 0);
+	for (auto * renderer : dynamicRenderers) if (rebake || renderer->dirty) {
+		glm::vec3 boundsMin, boundsMax;
+		renderer->getWorldBounds(boundsMin, boundsMax);
+		if (!rebake) {
+			const auto & voxelized = voxelizedBounds[renderer];
+			updateMin = glm::min(updateMin, toVoxel(glm::min(boundsMin, voxelized.first)) - 1); // One voxel of margin for
+			updateMax = glm::max(updateMax, toVoxel(glm::max(boundsMax, voxelized.second)) + 2); // conservative rasterization.
+		}
+		voxelizedBounds[renderer] = { boundsMin, boundsMax };
+	}
+	updateMin = glm::clamp(updateMin, 0, size);
+	updateMax = glm::clamp(updateMax, 0, size);
+	if (glm::any(glm::greaterThanEqual(updateMin, updateMax))) return false; // The changed renderers are outside of the voxel grid.
+
+	VoxelGrid grid(size);
+	GLfloat clearColor[4] = { 0, 0, 0, 0 };
+
+	// Bake the static layer.
+	if (rebake) {
+		staticRenderers.clear();
+		for (auto * renderer : renderers) if (!isIn(dynamicRenderers, renderer)) staticRenderers.push_back(renderer);
+
+		for (auto * texture : staticVoxelTextures) texture->Clear(clearColor);
+		renderVoxelizationPass(staticRenderers, grid, staticVoxelTextures, BAKE_STATIC_LAYER);
+		glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+		bakedRenderers = renderers;
+		bakedPointLights = renderingScene.pointLights;
+		bakedConservatively = conservativeVoxelization;
+		bakedAveraged = averageVoxelFragments;
+		bakedLevelOfDetail = voxelizationLevelOfDetail;
+		staticVoxelizationQueued = false;
+	}
+
+	// Restore the static layer, and voxelize the dynamic renderers on top of it.
+	const auto targets = getVoxelizationTargets();
+	const glm::ivec3 extent = updateMax - updateMin;
+	for (unsigned int i = 0; i < targets.size(); ++i) {
+		glCopyImageSubData(
+			staticVoxelTextures[i]->textureID, GL_TEXTURE_3D, 0, updateMin.x, updateMin.y, updateMin.z,
+			targets[i]->textureID, GL_TEXTURE_3D, 0, updateMin.x, updateMin.y, updateMin.z,
+			extent.x, extent.y, extent.z
+		);
+	}
+	grid.updateMin = updateMin;
+	grid.updateMax = updateMax;
+	renderVoxelizationPass(dynamicRenderers, grid, targets, ADD_STATIC_LAYER);
+	return true;
+}
+
+// ----------------------
+// Sparse voxel octree.
+// ----------------------
+void Graphics::initSparseVoxelOctree()
+{
+	glGenBuffers(1, &fragmentListBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, fragmentListBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, fragmentListCapacity * sizeof(SparseVoxelOctree::Fragment), nullptr, GL_DYNAMIC_COPY);
+
+	glGenBuffers(1, &fragmentCounterBuffer);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, fragmentCounterBuffer);
+	glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+	glGenBuffers(1, &octreeBuildBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeBuildBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(OctreeBuildState), nullptr, GL_DYNAMIC_COPY);
+
+	glGenBuffers(1, &octreeReadbackBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, octreeReadbackBuffer);
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glBufferStorage(GL_COPY_WRITE_BUFFER, 2 * sizeof(GLuint), nullptr, flags);
+	octreeReadback = (const GLuint *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, 2 * sizeof(GLuint), flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// Start out with an empty octree (i.e. an empty root tile).
+	glGenBuffers(1, &octreeNodeBuffer);
+	glGenBuffers(1, &octreeBrickBuffer);
+	glGenBuffers(1, &octreeSumBuffer);
+	resizeSparseVoxelOctree(1 << 16);
+}
+
+void Graphics::resizeSparseVoxelOctree(GLuint tiles)
+{
+	octreeTileCapacity = tiles;
+	for (GLuint buffer : { octreeNodeBuffer, octreeBrickBuffer }) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 8 * tiles * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+		glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, 8 * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeSumBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 5 * 8 * tiles * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	octreeLevels = 0;
+}
+
+bool Graphics::sparseVoxelOctreeChanged(Scene & renderingScene)
+{
+	const glm::ivec4 settings(glm::clamp(sparseVoxelOctreeLevels, 1, MAX_OCTREE_LEVELS), conservativeVoxelization, cpuVoxelization, maxLights);
+	bool changed = sparseVoxelOctreeQueued || sparseVoxelOctreeValidationQueued || renderingScene.renderers != octreeRenderers;
+	changed = changed || settings != octreeSettings || voxelizationLevelOfDetail != octreeLevelOfDetail;
+	changed = changed || pointLightsChanged(renderingScene.pointLights, octreePointLights); // Direct lighting is part of the octree.
+	for (auto * renderer : renderingScene.renderers) {
+		renderer->updateDirtyState();
+		changed = changed || renderer->dirty;
+	}
+	if (!changed) return false;
+
+	// The dirty state is shared with incremental voxelization, which hasn't seen these changes.
+	staticVoxelizationQueued = true;
+	sparseVoxelOctreeQueued = false;
+	octreeRenderers = renderingScene.renderers;
+	octreePointLights = renderingScene.pointLights;
+	octreeSettings = settings;
+	octreeLevelOfDetail = voxelizationLevelOfDetail;
+	return true;
+}
+
+void Graphics::checkSparseVoxelOctreeCapacity()
+{
+	if (octreeReadbackFence == nullptr || glClientWaitSync(octreeReadbackFence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) return;
+	glDeleteSync(octreeReadbackFence);
+	octreeReadbackFence = nullptr;
+
+	const GLuint numberOfFragments = octreeReadback[0], numberOfTiles = octreeReadback[1];
+	if (numberOfFragments > fragmentListCapacity) {
+		fragmentListCapacity = numberOfFragments + numberOfFragments / 2;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, fragmentListBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, fragmentListCapacity * sizeof(SparseVoxelOctree::Fragment), nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		sparseVoxelOctreeQueued = voxelizationQueued = true;
+	}
+	if (numberOfTiles > octreeTileCapacity) {
+		resizeSparseVoxelOctree(numberOfTiles + numberOfTiles / 2);
+		sparseVoxelOctreeQueued = voxelizationQueued = true;
+	}
+}
+
+void Graphics::buildSparseVoxelOctree(Scene & renderingScene)
+{
+	if (!sparseVoxelOctreeChanged(renderingScene)) return;
+	const GLuint levels = octreeSettings.x;
+
+	if (!cpuVoxelization) {
+		buildSparseVoxelOctreeOnGPU(renderingScene, levels);
+		if (sparseVoxelOctreeValidationQueued) validateSparseVoxelOctree();
+		return;
+	}
+
+	// The CPU voxelizer writes a fragment list as well, since a voxel grid at the resolution of the octree can take gigabytes.
+	cpuVoxelizer.voxelTextureSize = 1 << levels;
+	cpuVoxelizer.fragmentList = true;
+	cpuVoxelizer.voxelize(renderingScene);
+	cpuVoxelizer.fragmentList = false;
+	sparseVoxelOctree.build(cpuVoxelizer.fragments, 1 << levels);
+	std::vector<SparseVoxelOctree::Fragment>().swap(cpuVoxelizer.fragments);
+
+	// Upload the node and brick pools.
+	const GLuint tiles = sparseVoxelOctree.nodes.size() / 8;
+	if (tiles > octreeTileCapacity) resizeSparseVoxelOctree(tiles);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeNodeBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sparseVoxelOctree.nodes.size() * sizeof(GLuint), sparseVoxelOctree.nodes.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeBrickBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sparseVoxelOctree.bricks.size() * sizeof(GLuint), sparseVoxelOctree.bricks.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	octreeLevels = levels;
+}
+
+void Graphics::buildSparseVoxelOctreeOnGPU(Scene & renderingScene, GLuint levels)
+{
+	// Voxelize into the fragment list. Fragments that don't fit are dropped (see checkSparseVoxelOctreeCapacity).
+	const GLuint zero = 0;
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, fragmentCounterBuffer);
+	glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, fragmentCounterBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, fragmentListBuffer);
+	renderVoxelizationPass(renderingScene.renderers, VoxelGrid(1 << levels), {});
+
+	// Start out with only the root tile, which is empty.
+	const GLuint root[2] = { 1, 0 }; // OctreeBuildState::tileCount and firstTile[0].
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeBuildBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(OctreeBuildState, tileCount), sizeof(root), root);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeNodeBuffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, 8 * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeSumBuffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, 5 * 8 * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, octreeNodeBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, octreeBrickBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, octreeSumBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, octreeBuildBuffer);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, octreeBuildBuffer);
+	glMemoryBarrier(GL_ATOMIC_COUNTER_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	const auto dispatch = [&](OctreeBuildStage stage, GLuint depth) {
+		const Material * material = MaterialStore::getInstance().findMaterialVariant("build_octree", ShaderDefines().set("STAGE", stage));
+		glUseProgram(material->program);
+		glUniform1i(material->getUniformLocation(OCTREE_LEVELS_NAME), levels);
+		glUniform1i(material->getUniformLocation(OCTREE_DEPTH_NAME), depth);
+		switch (stage) {
+		case PREPARE_OCTREE_DEPTH: glDispatchCompute(1, 1, 1); break;
+		case FLAG_OCTREE_NODES: case WRITE_OCTREE_LEAVES: glDispatchComputeIndirect(offsetof(OctreeBuildState, fragmentDispatch)); break;
+		default: glDispatchComputeIndirect(offsetof(OctreeBuildState, tileDispatch) + depth * sizeof(OctreeBuildState::tileDispatch[0])); break;
+		}
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+	};
+
+	// Allocate the tiles top-down, and filter the bricks bottom-up.
+	dispatch(PREPARE_OCTREE_DEPTH, 0);
+	for (GLuint depth = 0; depth + 1 < levels; ++depth) {
+		dispatch(FLAG_OCTREE_NODES, depth);
+		dispatch(ALLOCATE_OCTREE_TILES, depth);
+		dispatch(PREPARE_OCTREE_DEPTH, depth + 1);
+	}
+	dispatch(WRITE_OCTREE_LEAVES, levels - 1);
+	for (GLuint depth = levels; depth-- > 0;) dispatch(FILTER_OCTREE_BRICKS, depth);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+	octreeLevels = levels;
+
+	// Read back how much space the build needed, without waiting for it.
+	glBindBuffer(GL_COPY_WRITE_BUFFER, octreeReadbackBuffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, fragmentCounterBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+	glBindBuffer(GL_COPY_READ_BUFFER, octreeBuildBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offsetof(OctreeBuildState, tileCount), sizeof(GLuint), sizeof(GLuint));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+	if (octreeReadbackFence != nullptr) glDeleteSync(octreeReadbackFence);
+	octreeReadbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void Graphics::validateSparseVoxelOctree()
+{
+	GLuint numberOfFragments = 0;
+	OctreeBuildState state;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, fragmentCounterBuffer);
+	glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &numberOfFragments);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeBuildBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(OctreeBuildState), &state);
+
+	// An incomplete build is not compared. The buffers grow, and the validation runs again on the rebuild.
+	if (numberOfFragments > fragmentListCapacity || state.tileCount > octreeTileCapacity) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return;
+	}
+	sparseVoxelOctreeValidationQueued = false;
+
+	std::vector<SparseVoxelOctree::Fragment> fragments(numberOfFragments);
+	std::vector<GLuint> nodes(8 * state.tileCount), bricks(8 * state.tileCount);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, fragmentListBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, fragments.size() * sizeof(SparseVoxelOctree::Fragment), fragments.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeNodeBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, nodes.size() * sizeof(GLuint), nodes.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, octreeBrickBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bricks.size() * sizeof(GLuint), bricks.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	const unsigned int resolution = 1 << octreeLevels;
+	double timestamp = glfwGetTime();
+	SparseVoxelOctree reference;
+	reference.build(fragments, resolution);
+	const double buildTime = glfwGetTime() - timestamp;
+
+	// Walk both octrees together. Tiles are allocated in a different order on the GPU, so they are matched by position.
+	unsigned int gpuOnlyTiles = 0, cpuOnlyTiles = 0, differentBricks = 0, maxDifference = 0;
+	std::vector<std::pair<GLuint, GLuint>> tiles = { { 0, 0 } };
+	while (!tiles.empty()) {
+		const GLuint gpuTile = tiles.back().first, cpuTile = tiles.back().second;
+		tiles.pop_back();
+		for (GLuint i = 0; i < 8; ++i) {
+			const GLuint gpuBrick = bricks[8 * gpuTile + i], cpuBrick = reference.bricks[8 * cpuTile + i];
+			unsigned int difference = 0;
+			for (unsigned int k = 0; k < 32; k += 8) difference = std::max<unsigned int>(difference, std::abs(int((gpuBrick >> k) & 0xff) - int((cpuBrick >> k) & 0xff)));
+			maxDifference = std::max(maxDifference, difference);
+			differentBricks += difference > 1; // Rounding.
+
+			const GLuint gpuChild = nodes[8 * gpuTile + i], cpuChild = reference.nodes[8 * cpuTile + i];
+			if (gpuChild != 0 && cpuChild != 0) tiles.push_back({ gpuChild, cpuChild });
+			else if (gpuChild != 0) ++gpuOnlyTiles;
+			else if (cpuChild != 0) ++cpuOnlyTiles;
+		}
+	}
+
+	// Benchmark the CPU traversal by sampling a lattice of positions on every level.
+	const unsigned int lattice = 32, samples = (reference.getLevels() + 1) * lattice * lattice * lattice;
+	float coverage = 0.0f;
+	timestamp = glfwGetTime();
+	for (unsigned int level = 0; level <= reference.getLevels(); ++level) {
+		for (unsigned int i = 0; i < lattice * lattice * lattice; ++i) {
+			const glm::vec3 position = (glm::vec3(i % lattice, (i / lattice) % lattice, i / (lattice * lattice)) + 0.5f) / float(lattice);
+			coverage += reference.sample(position, float(level)).a;
+		}
+	}
+	const double sampleTime = (glfwGetTime() - timestamp) / samples;
+
+	std::cout << "- Sparse voxel octree validation (" << resolution << "^3, " << numberOfFragments << " fragments): "
+		<< state.tileCount << " tiles on the GPU, " << reference.nodes.size() / 8 << " on the CPU. "
+		<< gpuOnlyTiles << " subtrees only on the GPU, " << cpuOnlyTiles << " only on the CPU. "
+		<< differentBricks << " bricks differ by more than 1/255 (max " << maxDifference << "/255)." << std::endl;
+	std::cout << "  CPU octree: built in " << 1000 * buildTime << " ms, " << 1e9 * sampleTime << " ns per sample, "
+		<< (reference.getMemoryUsage() >> 10) << " KB (a mipmapped RGBA8 texture takes "
+		<< ((4 * size_t(resolution) * resolution * resolution * 8 / 7) >> 10) << " KB). Mean sampled alpha: " << coverage / samples << "." << std::endl;
+}
+
+// ----------------------
+// Clipmap.
+// ----------------------
+void Graphics::updateClipmap(Scene & renderingScene, bool voxelizeNow)
+{
+	const unsigned int cascades = glm::clamp(clipmapCascades, 1, MAX_CLIPMAP_CASCADES);
+	const int size = voxelTexture->width;
+
+	// (Re)allocate the cascades if the settings have changed. Cascades wrap around, since they are addressed toroidally.
+	bool voxelizeAll = voxelizationQueued || clipmapVoxelizedExtent != clipmapExtent;
+	if (clipmapTextures.size() != cascades || clipmapTextures[0]->width != size) {
+		for (auto * texture : clipmapTextures) delete texture;
+		clipmapTextures.clear();
+		for (unsigned int i = 0; i < cascades; ++i) clipmapTextures.push_back(new Texture3D(std::vector<GLfloat>(), size, size, size, true, GL_REPEAT));
+		clipmapOrigins.assign(cascades, glm::ivec3(0));
+		voxelizeAll = true;
+	}
+	clipmapVoxelizedExtent = clipmapExtent;
+
+	const glm::vec3 cameraPosition = renderingScene.renderingCamera->position;
+	for (unsigned int i = 0; i < cascades; ++i) {
+		// Center the cascade on the camera, snapped to its voxels.
+		const glm::ivec3 origin = glm::ivec3(glm::round(cameraPosition / getClipmapVoxelSize(i))) - size / 2;
+		const glm::ivec3 delta = origin - clipmapOrigins[i];
+		clipmapOrigins[i] = origin;
+
+		bool updated = true;
+		if (voxelizeAll || (voxelizeNow && i == nextClipmapCascade) || glm::any(glm::greaterThanEqual(glm::abs(delta), glm::ivec3(size)))) {
+			voxelizeClipmapRegion(renderingScene, i, origin, origin + size);
+		}
+		else if (delta != glm::ivec3(0)) {
+			// Only voxelize the slabs that have scrolled into the cascade.
+			for (unsigned int axis = 0; axis < 3; ++axis) {
+				if (delta[axis] == 0) continue;
+				glm::ivec3 slabMin = origin, slabMax = origin + size;
+				if (delta[axis] > 0) slabMin[axis] = slabMax[axis] - delta[axis];
+				else slabMax[axis] = slabMin[axis] - delta[axis];
+				voxelizeClipmapRegion(renderingScene, i, slabMin, slabMax);
+			}
+		}
+		else updated = false;
+
+		if (updated && computeShaderMipmaps) {
+			buildMipmap(clipmapTextures[i], glm::ivec3(0), glm::ivec3(size));
+		}
+		else if (updated) {
+			glBindTexture(GL_TEXTURE_3D, clipmapTextures[i]->textureID);
+			glGenerateMipmap(GL_TEXTURE_3D);
+		}
+	}
+	if (voxelizeNow) nextClipmapCascade = (nextClipmapCascade + 1) % cascades;
+}
+
+void Graphics::voxelizeClipmapRegion(Scene & renderingScene, unsigned int cascade, glm::ivec3 updateMin, glm::ivec3 updateMax)
+{
+	Texture3D * texture = clipmapTextures[cascade];
+	const int size = texture->width;
+
+	// Clear the region. It wraps around at most once along every axis, so it's cleared as up to 8 boxes.
+	GLfloat clearColor[4] = { 0, 0, 0, 0 };
+	const glm::ivec3 start = updateMin & (size - 1), extent = updateMax - updateMin;
+	for (unsigned int i = 0; i < 8; ++i) {
+		glm::ivec3 boxMin, boxSize;
+		for (unsigned int axis = 0; axis < 3; ++axis) {
+			const int firstPart = std::min(extent[axis], size - start[axis]);
+			const bool wrapped = ((i >> axis) & 1) != 0;
+			boxMin[axis] = wrapped ? 0 : start[axis];
+			boxSize[axis] = wrapped ? extent[axis] - firstPart : firstPart;
+		}
+		if (boxSize.x > 0 && boxSize.y > 0 && boxSize.z > 0) texture->Clear(clearColor, boxMin.x, boxMin.y, boxMin.z, boxSize.x, boxSize.y, boxSize.z);
+	}
+
+	// Voxelize the region.
+	VoxelGrid grid(size);
+	grid.extent = 0.5f * size * getClipmapVoxelSize(cascade);
+	grid.center = getClipmapVoxelSize(cascade) * glm::vec3(clipmapOrigins[cascade]) + grid.extent;
+	grid.toroidal = true;
+	grid.updateMin = updateMin;
+	grid.updateMax = updateMax;
+
+	renderVoxelizationPass(renderingScene.renderers, grid, { texture });
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+float Graphics::getClipmapVoxelSize(unsigned int cascade) const
+{
+	return 2.0f * clipmapVoxelizedExtent * (1 << cascade) / voxelTexture->width;
 }
 
 // ----------------------
@@ -204,18 +1361,17 @@ void Graphics::initVoxelVisualization(unsigned int viewportWidth, unsigned int v
 
 	// Rendering quad.
 	quad = StandardShapes::createQuad();
+	quad.packedVertexData = false; // The screen quad shaders read the positions without a model matrix.
 	quadMeshRenderer = new MeshRenderer(&quad);
 }
 
-void Graphics::renderVoxelVisualization(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight)
+void Graphics::renderVoxelVisualization(unsigned int viewportWidth, unsigned int viewportHeight)
 {
 	// -------------------------------------------------------
 	// Render cube to FBOs.
 	// -------------------------------------------------------
-	Camera & camera = *renderingScene.renderingCamera;
-	auto program = worldPositionMaterial->program;
-	glUseProgram(program);
-	uploadCamera(camera, program);
+	const Material * material = worldPositionMaterial;
+	glUseProgram(material->program);
 
 	// Settings.
 	glClearColor(0.0, 0.0, 0.0, 1.0);
@@ -227,38 +1383,38 @@ void Graphics::renderVoxelVisualization(Scene & renderingScene, unsigned int vie
 	glBindFramebuffer(GL_FRAMEBUFFER, vvfbo1->frameBuffer);
 	glViewport(0, 0, vvfbo1->width, vvfbo1->height);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	cubeMeshRenderer->render(program);
+	cubeMeshRenderer->render(material);
 
 	// Front.
 	glCullFace(GL_BACK);
 	glBindFramebuffer(GL_FRAMEBUFFER, vvfbo2->frameBuffer);
 	glViewport(0, 0, vvfbo2->width, vvfbo2->height);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	cubeMeshRenderer->render(program);
+	cubeMeshRenderer->render(material);
 
 	// -------------------------------------------------------
 	// Render 3D texture to screen.
 	// -------------------------------------------------------
-	program = voxelVisualizationMaterial->program;
-	glUseProgram(program);
-	uploadCamera(camera, program);
+	material = voxelVisualizationMaterial;
+	glUseProgram(material->program);
 	glBindRenderbuffer(GL_RENDERBUFFER, 0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	// Settings.
-	uploadGlobalConstants(voxelVisualizationMaterial->program, viewportWidth, viewportHeight);
+	uploadGlobalConstants(material, viewportWidth, viewportHeight);
+	uploadVoxelStorage(material);
 	glDisable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
 
 	// Activate textures.
-	vvfbo1->ActivateAsTexture(program, "textureBack", 0);
-	vvfbo2->ActivateAsTexture(program, "textureFront", 1);
-	voxelTexture->Activate(program, "texture3D", 2);
+	vvfbo1->ActivateAsTexture(material, "textureBack", 0);
+	vvfbo2->ActivateAsTexture(material, "textureFront", 1);
+	voxelTexture->Activate(material, "texture3D", 2);
 
 	// Render.
 	glViewport(0, 0, viewportWidth, viewportHeight);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	quadMeshRenderer->render(program);
+	quadMeshRenderer->render(material);
 }
 
 Graphics::~Graphics()
@@ -269,4 +1425,27 @@ Graphics::~Graphics()
 	if (cubeMeshRenderer) delete cubeMeshRenderer;
 	if (cubeShape) delete cubeShape;
 	if (voxelTexture) delete voxelTexture;
+	if (indirectDiffuseFBO) delete indirectDiffuseFBO;
+	if (indirectDiffuseHistoryFBO) delete indirectDiffuseHistoryFBO;
+	if (gBuffer) delete gBuffer;
+	for (auto * texture : staticVoxelTextures) delete texture;
+	for (auto * texture : surfaceVoxelTextures) delete texture;
+	glDeleteBuffers(1, &fragmentListBuffer);
+	glDeleteBuffers(1, &fragmentCounterBuffer);
+	glDeleteBuffers(1, &octreeNodeBuffer);
+	glDeleteBuffers(1, &octreeBrickBuffer);
+	glDeleteBuffers(1, &octreeSumBuffer);
+	glDeleteBuffers(1, &octreeBuildBuffer);
+	glDeleteBuffers(1, &octreeReadbackBuffer);
+	if (octreeReadbackFence != nullptr) glDeleteSync(octreeReadbackFence);
+	glDeleteBuffers(1, &voxelAccumulationBuffer);
+	glDeleteBuffers(1, &staticVoxelAccumulationBuffer);
+	glDeleteBuffers(1, &frameUniformBuffer);
+	glDeleteBuffers(1, &lightsUniformBuffer);
+	glDeleteBuffers(1, &materialUniformBuffer);
+	glDeleteBuffers(1, &materialStorageBuffer);
+	glDeleteBuffers(1, &drawStorageBuffer);
+	glDeleteBuffers(1, &drawCommandBuffer);
+	for (auto * texture : clipmapTextures) delete texture;
+	for (auto * texture : anisotropicVoxelTextures) delete texture;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
 
 #define GLEW_STATIC
 #include <glew.h>
@@ -8,10 +9,15 @@
 
 #include "..\Scene\Scene.h"
 #include "Material\Material.h"
+#include "Material\ShaderDefines.h"
 #include "FBO\FBO.h"
 #include "Camera\OrthographicCamera.h"
 #include "../Shape/Mesh.h"
 #include "Texture3D.h"
+#include "Voxelization\CPUVoxelizer.h"
+#include "Voxelization\SparseVoxelOctree.h"
+#include "Voxelization\VoxelMipmap.h"
+#include "Renderer\MeshBatch.h"
 
 class MeshRenderer;
 class Shape;
@@ -25,6 +31,12 @@ public:
 		VOXEL_CONE_TRACING = 1			// Global illumination using voxel cone tracing.
 	};
 
+	enum VoxelStorage {
+		DENSE_TEXTURE = 0,			// A dense mipmapped 3D texture.
+		SPARSE_VOXEL_OCTREE = 1,	// A sparse voxel octree built from the voxelization fragment list.
+		CLIPMAP = 2					// Nested cascades centered on the camera (see clipmapCascades).
+	};
+
 	/// <summary> Initializes rendering. </summary>
 	virtual void init(unsigned int viewportWidth, unsigned int viewportHeight); // Called pre-render once per run.
 
@@ -37,10 +49,21 @@ public:
 	// ----------------
 	// Rendering.
 	// ----------------
+	// The cone tracing shader is compiled in a permutation per combination of these settings (see getVoxelConeTracingMaterial).
 	bool shadows = true;
 	bool indirectDiffuseLight = true;
 	bool indirectSpecularLight = true;
 	bool directLight = true;
+	bool gammaCorrection = true;
+	int specularMode = 1; // 0 == Blinn-Phong (halfway vector), 1 == reflection model.
+	int maxLights = 1; // The number of point lights that the shaders support. Also used by the voxelization shaders.
+	bool deferredShading = false; // Renders a G-buffer first, so that cones are traced once per pixel regardless of overdraw.
+	int indirectDiffuseDownsampling = 1; // Traces indirect diffuse light at 1/n of the viewport resolution (1, 2 or 4) and upsamples it.
+	int diffuseCones = 9; // The number of indirect diffuse cones (1, 5, 6, 9 or 16). Every cone set is a separately compiled shader variant.
+	bool temporalIndirectDiffuse = false; // Traces a third of the diffuse cones per frame and accumulates them with the reprojected previous frames.
+	bool multiDrawIndirect = false; // Draws the static meshes of every rendering queue using a single glMultiDrawElementsIndirect. Only packed meshes are batched.
+	bool packedVertexData = false; // Uploads the meshes of the scene in a compact 12 byte vertex format (see PackedVertexData), which quantizes positions and normals.
+	bool multiDrawValidationQueued = false; // Compares the next frame drawn using multi-draw indirect with one drawn renderer by renderer.
 
 	// ----------------
 	// Voxelization.
@@ -51,50 +74,352 @@ public:
 	bool voxelizationQueued = true;
 	int voxelizationSparsity = 1; // Number of ticks between mipmap generation. 
 	// (voxelization sparsity gives unstable framerates, so not sure if it's worth it in interactive applications.)
+	int voxelTextureSize = 64; // Resolution of the voxel texture. Must be a power of 2 (at most 1024). Can be changed at runtime.
+	bool conservativeVoxelization = false; // Conservative rasterization, i.e. thin geometry doesn't drop voxels.
+	bool averageVoxelFragments = false; // Averages all fragments in a voxel (order independent) instead of keeping an arbitrary one.
+	bool cpuVoxelization = false; // Uses the multithreaded CPU reference voxelizer instead of the GPU voxelization pass.
+	bool voxelizationValidationQueued = false; // Compares the next GPU voxelization with the CPU reference voxelizer.
+	bool incrementalVoxelization = false; // Only re-voxelizes renderers that move or change, on top of a baked static layer.
+	bool computeShaderMipmaps = false; // Builds the voxel mipmap using mipmap.comp instead of glGenerateMipmap.
+	bool anisotropicVoxels = false; // Stores mipmap levels >= 1 of the voxel texture as six directional volumes (less light leaking).
+	bool voxelLightInjection = false; // Voxelizes albedo, normal and emission, and lights them in a separate pass (see inject_light.comp).
+	VoxelStorage voxelStorage = VoxelStorage::DENSE_TEXTURE;
+	int sparseVoxelOctreeLevels = 8; // The sparse voxel octree has a resolution of 2^levels, i.e. 8 => 256x256x256. At most 10.
+	bool sparseVoxelOctreeValidationQueued = false; // Compares the next GPU octree build with the CPU octree, and benchmarks the CPU octree.
+	int clipmapCascades = 4; // Number of clipmap cascades. Every cascade has the resolution of the voxel texture. At most 6.
+	float clipmapExtent = 1.0f; // Half extent of the smallest clipmap cascade. Every cascade is twice as large as the previous one.
+	float voxelizationLevelOfDetail = 0.0f; // Voxelizes the coarsest level of detail whose error is at most this many voxels (0 == full detail).
 
 	~Graphics();
 private:
 	// ----------------
 	// GLSL uniform names.
 	// ----------------
-	const char * PROJECTION_MATRIX_NAME = "P";
-	const char * VIEW_MATRIX_NAME = "V";
-	const char * CAMERA_POSITION_NAME = "cameraPosition";
-	const char * NUMBER_OF_LIGHTS_NAME = "numberOfLights";
 	const char * SCREEN_SIZE_NAME = "screenSize";
-	const char * APP_STATE_NAME = "state";
+	const char * CONSERVATIVE_VOXELIZATION_NAME = "conservative";
+	const char * VOXEL_GRID_SIZE_NAME = "voxelGridSize";
+	const char * FRAGMENT_LIST_NAME = "fragmentList";
+	const char * AVERAGE_VOXEL_FRAGMENTS_NAME = "averageFragments";
+	const char * STATIC_LAYER_NAME = "staticLayer";
+	const char * NUMBER_OF_LAYERS_NAME = "numberOfLayers";
+	const char * LIGHT_INJECTION_NAME = "lightInjection";
+	const char * VOXEL_LAYER_NAMES[3] = { "texture3D", "normalVolume", "emissionVolume" }; // The image of every voxelization target.
+	const char * ALBEDO_VOLUME_NAME = "albedoVolume";
+	const char * INDIRECT_DIFFUSE_BUFFER_NAME = "indirectDiffuseBuffer";
+	const char * INDIRECT_DIFFUSE_GEOMETRY_NAME = "indirectDiffuseGeometry";
+	const char * TEMPORAL_HISTORY_NAME = "temporalHistory";
+	const char * TEMPORAL_FRAME_NAME = "temporalFrame";
+	const char * PREVIOUS_VIEW_PROJECTION_NAME = "previousViewProjection";
+	const char * PREVIOUS_CAMERA_POSITION_NAME = "previousCameraPosition";
+	const char * G_BUFFER_NAMES[5] = { "gBufferPosition", "gBufferNormal", "gBufferDiffuse", "gBufferSpecular", "gBufferMaterial" };
+	const char * VOXEL_STORAGE_NAME = "voxelStorage";
+	const char * OCTREE_LEVELS_NAME = "octreeLevels";
+	const char * OCTREE_DEPTH_NAME = "depth";
+	const char * VOXEL_SIZE_NAME = "voxelSize";
+	const char * VOXEL_GRID_REGION_NAME = "voxelGridRegion";
+	const char * TOROIDAL_NAME = "toroidal";
+	const char * UPDATE_MIN_NAME = "updateMin";
+	const char * UPDATE_MAX_NAME = "updateMax";
+	const char * CLIPMAP_CASCADES_NAME = "clipmapCascades";
+	const char * CLIPMAP_REGIONS_NAME = "clipmapRegions";
+	const char * CLIPMAP_NAME = "clipmap";
+	const char * ANISOTROPIC_VOXEL_TEXTURES_NAME = "texture3DAnisotropic";
+	const char * MIPMAP_SOURCE_NAME = "source";
+	const char * MIPMAP_SOURCE_LEVEL_NAME = "sourceLevel";
+	const char * MIPMAP_DIRECTION_NAME = "direction";
+	const char * MIPMAP_LEVELS_NAME = "levels";
+	const char * MIPMAP_OFFSET_NAME = "offset";
+	const char * MIPMAP_DESTINATION_NAME = "destination";
 
 	// ----------------
 	// Rendering.
 	// ----------------
 	void renderScene(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight);
-	void renderQueue(RenderingQueue renderingQueue, const GLuint program, bool uploadMaterialSettings = false) const;
-	void uploadGlobalConstants(const GLuint program, unsigned int viewportWidth, unsigned int viewportHeight) const;
-	void uploadCamera(Camera & camera, const GLuint program);
-	void uploadLighting(Scene & renderingScene, const GLuint glProgram) const;
-	void uploadRenderingSettings(const GLuint glProgram) const;
+	/// <summary> Renders the scene with and without multi-draw indirect, and prints how the frames differ. </summary>
+	void validateMultiDraw(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight);
+	/// <summary> Draws the enabled renderers of a queue. If multiDrawIndirect is set, the material has to be compiled
+	/// with MULTI_DRAW set (i.e. read the transforms and material settings of the draws from storage buffers).
+	/// Every mesh is drawn at the coarsest level of detail whose world space error is at most maxError. </summary>
+	void renderQueue(RenderingQueue renderingQueue, const Material * material, bool bindMaterialSettings = false, float maxError = 0.0f);
+	/// <summary> Returns the level of detail of a renderer's mesh for a world space error (see Mesh::getLevelOfDetail). </summary>
+	static unsigned int getLevelOfDetail(const MeshRenderer * renderer, const glm::mat4 & M, float maxError);
+	void uploadGlobalConstants(const Material * material, unsigned int viewportWidth, unsigned int viewportHeight) const;
+	void uploadVoxelStorage(const Material * material) const;
+
+	// ----------------
+	// Renderers.
+	// ----------------
+	// Renderer i of the scene has index i + 1 in the per-frame arrays, i.e. the world matrices and the material blocks.
+	// Index 0 is used by renderers that aren't part of the scene.
+	std::unordered_map<const MeshRenderer *, GLuint> rendererIndices;
+	std::vector<glm::mat4> worldMatrices; // Calculated once per frame, and shared by all passes.
+	/// <summary> Indexes the renderers of the scene and calculates their world matrices. </summary>
+	void updateRenderers(Scene & renderingScene);
+	GLuint getRendererIndex(const MeshRenderer * renderer) const;
+	/// <summary> Returns the world matrix of a renderer, i.e. the cached one if it's part of the scene. </summary>
+	const glm::mat4 & getWorldMatrix(MeshRenderer * renderer);
+
+	// ----------------
+	// Uniform buffers.
+	// ----------------
+	// Data that is shared by all programs is uploaded once per frame as std140 uniform blocks (see uploadUniformBuffers).
+	// The structs below must match the blocks of the same name in the shaders.
+	enum UniformBufferBinding {
+		FRAME_BINDING = 0,		// Frame: camera and application state.
+		LIGHTS_BINDING = 1,		// Lights: Scene::pointLights.
+		MATERIAL_BINDING = 2	// MaterialSettings: the material setting of the renderer being drawn (see renderQueue).
+	};
+	struct FrameBlock {
+		glm::mat4 V, P;
+		glm::vec3 cameraPosition;
+		GLint state;
+	};
+	struct PointLightBlock {
+		glm::vec4 position, color;
+	};
+	struct MaterialBlock {
+		glm::vec3 diffuseColor;
+		GLfloat diffuseReflectivity;
+		glm::vec3 specularColor;
+		GLfloat specularDiffusion, specularReflectivity, emissivity, refractiveIndex, transparency;
+	};
+	GLuint frameUniformBuffer = 0, lightsUniformBuffer = 0, materialUniformBuffer = 0;
+	GLintptr materialBlockStride; // sizeof(MaterialBlock) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+	void initUniformBuffers();
+	/// <summary> Uploads the camera, the lights and the material setting of every renderer (by renderer index), and binds the per-frame blocks. </summary>
+	void uploadUniformBuffers(Scene & renderingScene);
+
+	// ----------------
+	// Multi-draw indirect.
+	// ----------------
+	// Static meshes are drawn from shared buffers using one draw command each, and the transform and material setting of
+	// every draw are read from storage buffers (see voxel_cone_tracing.vert). Storage buffer 5 holds the draws of the
+	// latest rendering queue, and storage buffer 6 holds the material blocks of uploadUniformBuffers (without padding).
+	struct DrawBlock {
+		glm::mat4 M;
+		GLuint materialIndex, padding[3]; // The size of a std430 Draw is a multiple of its alignment (i.e. that of mat4).
+	};
+	struct DrawElementsIndirectCommand {
+		GLuint count, instanceCount, firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+	MeshBatch meshBatch;
+	GLuint drawStorageBuffer = 0, materialStorageBuffer = 0, drawCommandBuffer = 0;
+	std::vector<DrawBlock> drawBlocks;
+	std::vector<DrawElementsIndirectCommand> drawCommands;
+	/// <summary> Draws the static meshes of a queue using one glMultiDrawElementsIndirect, and the rest one by one. </summary>
+	void renderQueueIndirect(RenderingQueue renderingQueue, const Material * material, float maxError);
+	/// <summary> Returns true if a mesh is drawn from the batch, i.e. if it's static and its vertices are packed. </summary>
+	static bool isBatched(const Mesh * mesh);
 
 	// ----------------
 	// Voxel cone tracing.
 	// ----------------
-	Material * voxelConeTracingMaterial;
+	/// <summary> How a cone tracing pass handles indirect diffuse light. Every mode is a separately compiled permutation. </summary>
+	enum IndirectDiffuseMode {
+		TRACE_PER_FRAGMENT = 0,		// Indirect diffuse cones are traced for every fragment.
+		TRACE_DOWNSAMPLED = 1,		// Only indirect diffuse cones are traced, into the downsampled buffer.
+		UPSAMPLE = 2,				// Indirect diffuse light is upsampled from the downsampled buffer.
+		TRACE_TEMPORAL = 3			// Like TRACE_DOWNSAMPLED, but a subset of the cones is traced and accumulated with the history.
+	};
+	/// <summary> Returns the permutation of the voxel cone tracing material for the current settings and a pass (see IndirectDiffuseMode). </summary>
+	Material * getVoxelConeTracingMaterial(IndirectDiffuseMode indirectDiffuseMode) const;
+	/// <summary> Returns the permutation of a material that lights voxels (i.e. supports maxLights lights). </summary>
+	Material * getLightingMaterial(const std::string & name, ShaderDefines defines = ShaderDefines()) const;
+
+	// ----------------
+	// Deferred shading.
+	// ----------------
+	/// <summary> Position, normal and material of every pixel (see gbuffer.frag). Attachment 0 is RGBA32F, the rest RGBA16F. </summary>
+	FBO * gBuffer = nullptr;
+	/// <summary> Returns the permutation of the G-buffer material for the current settings. </summary>
+	Material * getGBufferMaterial() const;
+	void renderGBuffer(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight);
+	void uploadGBuffer(const Material * material) const;
+	/// <summary> Renders the surfaces that are shaded by a voxel cone tracing program, i.e. the scene or a screen quad if deferred. </summary>
+	void renderConeTracedSurfaces(Scene & renderingScene, const Material * material);
+
+	// ----------------
+	// Downsampled indirect diffuse light.
+	// ----------------
+	/// <summary> Irradiance (attachment 0), and normal and depth (attachment 1) at 1/indirectDiffuseDownsampling of the viewport resolution.
+	/// When temporal, the alpha of attachment 0 is the number of frames accumulated. </summary>
+	FBO * indirectDiffuseFBO = nullptr;
+	/// <summary> The downsampled buffer of the previous frame. Swapped with indirectDiffuseFBO every temporal frame. </summary>
+	FBO * indirectDiffuseHistoryFBO = nullptr;
+	bool temporalHistory = false; // Whether indirectDiffuseHistoryFBO holds the previous frame.
+	unsigned int temporalFrame = 0; // Selects the subset of cones that is traced.
+	glm::mat4 previousViewProjection; // The camera that indirectDiffuseHistoryFBO was rendered with.
+	glm::vec3 previousCameraPosition;
+	/// <summary> Traces indirect diffuse light into the downsampled buffer. </summary>
+	void renderIndirectDiffuse(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight);
+	void uploadIndirectDiffuse(const Material * material, IndirectDiffuseMode mode) const;
 
 	// ----------------
 	// Voxelization.
 	// ----------------
+	/// <summary> Describes where a voxelization pass writes. Voxel coordinates are relative to the grid's minimum corner,
+	/// or to the world origin if the grid is toroidal. Only voxels in [updateMin, updateMax) are written. </summary>
+	struct VoxelGrid {
+		GLuint size;
+		glm::vec3 center = glm::vec3(0.0f);
+		float extent = 1.0f;
+		bool toroidal = false;
+		glm::ivec3 updateMin, updateMax;
+		VoxelGrid(GLuint _size) : size(_size), updateMin(0), updateMax(_size) {}
+	};
+
 	int ticksSinceLastVoxelization = voxelizationSparsity;
-	GLuint voxelTextureSize = 64; // Must be set to a power of 2.
 	OrthographicCamera voxelCamera;
-	Material * voxelizationMaterial;
 	Texture3D * voxelTexture = nullptr;
+	CPUVoxelizer cpuVoxelizer;
 	void initVoxelization();
+	void initVoxelTexture();
 	void voxelize(Scene & renderingScene, bool clearVoxelizationFirst = true);
+	void voxelizeOnCPU(Scene & renderingScene);
+	/// <summary> Reads back the base level of the voxel texture and prints how it differs from the CPU reference voxelization. </summary>
+	void validateVoxelization(Scene & renderingScene);
+	/// <summary> How a voxelization pass that averages fragments uses the static layer of incremental voxelization. </summary>
+	enum StaticLayerAccumulation {
+		IGNORE_STATIC_LAYER = 0,	// Only the fragments of this pass are averaged.
+		BAKE_STATIC_LAYER = 1,		// This pass voxelizes the static layer. Its sums are kept for later passes.
+		ADD_STATIC_LAYER = 2		// The fragments of the static layer are included in the averages.
+	};
+
+	/// <summary> Voxelizes renderers. With one target, the lit voxels are written to it. With three targets, the albedo,
+	/// normal and emission of the voxels are written to them (see injectLight). Without targets, voxels are written to the fragment list. </summary>
+	void renderVoxelizationPass(
+		RenderingQueue renderers, const VoxelGrid & grid, const std::vector<Texture3D*> & targets,
+		StaticLayerAccumulation staticLayer = IGNORE_STATIC_LAYER
+	);
+	/// <summary> The targets of the dense voxelization passes, i.e. the voxel texture or the surface volumes. </summary>
+	std::vector<Texture3D*> getVoxelizationTargets() const;
+
+	// ----------------
+	// Light injection.
+	// ----------------
+	/// <summary> The albedo, normal and emission volumes. Only allocated if voxelLightInjection is set. </summary>
+	std::vector<Texture3D*> surfaceVoxelTextures;
+	std::vector<PointLight> injectedPointLights; // The lights that the voxel texture was lit with.
+	/// <summary> Lights [updateMin, updateMax) of the surface volumes, and writes the result to the voxel texture. </summary>
+	void injectLight(Scene & renderingScene, glm::ivec3 updateMin, glm::ivec3 updateMax);
+
+	// ----------------
+	// Voxel averaging.
+	// ----------------
+	Material * averageVoxelsMaterial;
+	GLuint voxelAccumulationBuffer = 0; // Fixed point sums and fragment counts (see voxelization.frag and average_voxels.comp).
+	GLuint staticVoxelAccumulationBuffer = 0; // The sums and counts of the static layer. Only allocated for incremental voxelization.
+	GLsizeiptr voxelAccumulationBufferSize = 0, staticVoxelAccumulationBufferSize = 0;
+	static const GLsizeiptr MAX_VOXEL_ACCUMULATION_MEMORY = GLsizeiptr(512) << 20; // Larger grids are voxelized without averaging.
+	GLsizeiptr rejectedVoxelAccumulationMemory = 0; // The last amount of memory that was too large, so that it's only reported once.
+	/// <summary> Allocates the accumulation buffers for a voxel grid (and the static layer's, if it is used).
+	/// Returns false if they would exceed MAX_VOXEL_ACCUMULATION_MEMORY, or if they couldn't be allocated. </summary>
+	bool reserveVoxelAccumulationBuffers(GLuint size, GLuint numberOfLayers, bool staticLayer);
+	bool bakedAveraged = false; // Whether the static layer was voxelized with averaging (i.e. has sums).
+
+	// ----------------
+	// Voxel mipmapping.
+	// ----------------
+	/// <summary> The directional volumes (+x, -x, +y, -y, +z, -z) of the anisotropic voxel texture.
+	/// Level 0 of every volume has half the resolution of the voxel texture, i.e. it replaces level 1. </summary>
+	std::vector<Texture3D*> anisotropicVoxelTextures;
+	Material * mipmapMaterial, * anisotropicMipmapMaterial;
+	VoxelMipmap cpuVoxelMipmap;
+	/// <summary> Rebuilds the parts of the mipmap (and of the directional volumes) that cover [regionMin, regionMax) of level 0. </summary>
+	void generateVoxelMipmaps(glm::ivec3 regionMin, glm::ivec3 regionMax);
+	void generateVoxelMipmaps() { generateVoxelMipmaps(glm::ivec3(0), glm::ivec3(voxelTexture->width)); }
+	void buildMipmap(Texture3D * texture, glm::ivec3 regionMin, glm::ivec3 regionMax);
+	void buildAnisotropicMipmap(glm::ivec3 regionMin, glm::ivec3 regionMax);
+
+	// ----------------
+	// Incremental voxelization.
+	// ----------------
+	/// <summary> Renderers that have changed since they were first voxelized are dynamic. Everything else is static,
+	/// and is baked into the static layer, which is copied to the voxelization targets before the dynamic renderers are voxelized. </summary>
+	std::vector<Texture3D*> staticVoxelTextures; // One per voxelization target.
+	std::vector<MeshRenderer*> staticRenderers, dynamicRenderers;
+	std::vector<MeshRenderer*> bakedRenderers; // The renderers of the scene when the static layer was baked.
+	std::vector<PointLight> bakedPointLights; // Without light injection, direct lighting is part of the static layer.
+	std::unordered_map<MeshRenderer*, std::pair<glm::vec3, glm::vec3>> voxelizedBounds; // Where the dynamic renderers were voxelized.
+	bool bakedConservatively = false;
+	float bakedLevelOfDetail = 0.0f; // The voxelizationLevelOfDetail of the static layer.
+	bool staticVoxelizationQueued = true;
+	/// <summary> Returns false if the voxel texture is already up to date. Otherwise, returns the part of it that has been updated. </summary>
+	bool voxelizeIncrementally(Scene & renderingScene, glm::ivec3 & updateMin, glm::ivec3 & updateMax);
+
+	// ----------------
+	// Sparse voxel octree.
+	// ----------------
+	static const int MAX_OCTREE_LEVELS = 10; // Must match build_octree.comp.
+
+	/// <summary> The passes of the octree build on the GPU. Must match build_octree.comp. </summary>
+	enum OctreeBuildStage {
+		PREPARE_OCTREE_DEPTH = 0,	// Finishes the tiles at a depth, and computes the work groups of the passes that follow.
+		FLAG_OCTREE_NODES = 1,		// Flags the nodes at a depth that contain fragments.
+		ALLOCATE_OCTREE_TILES = 2,	// Allocates a child tile for every flagged node at a depth.
+		WRITE_OCTREE_LEAVES = 3,	// Adds every fragment to the sums of its leaf.
+		FILTER_OCTREE_BRICKS = 4	// Filters the bricks of the nodes at a depth.
+	};
+
+	/// <summary> The state of the octree build on the GPU (the OctreeBuild buffer of build_octree.comp, std430).
+	/// Every pass is dispatched indirectly, so the counts never have to be read back during a build. </summary>
+	struct OctreeBuildState {
+		GLuint fragmentDispatch[4]; // The work groups for the fragment list.
+		GLuint tileDispatch[MAX_OCTREE_LEVELS][4]; // The work groups for the nodes of the tiles at every depth.
+		GLuint tileCount; // The number of allocated tiles. Can exceed the capacity of the node pool.
+		GLuint firstTile[MAX_OCTREE_LEVELS + 1]; // The tiles at depth d are [firstTile[d], firstTile[d + 1]).
+	};
+
+	SparseVoxelOctree sparseVoxelOctree; // Only used for CPU voxelization. Otherwise, the octree is built on the GPU.
+	GLuint octreeLevels = 0; // The number of levels of the octree in the node and brick pools.
+	GLuint fragmentListCapacity = 1 << 20; // Number of fragments. Grows when the fragment list overflows.
+	GLuint octreeTileCapacity = 0; // Number of tiles in the node and brick pools. Grows when the node pool overflows.
+	GLuint fragmentListBuffer = 0, fragmentCounterBuffer = 0, octreeNodeBuffer = 0, octreeBrickBuffer = 0;
+	GLuint octreeSumBuffer = 0; // Fragment sums and filtered colors of every node (see build_octree.comp).
+	GLuint octreeBuildBuffer = 0; // OctreeBuildState.
+
+	// The number of fragments and tiles of the last build are copied to a persistently mapped buffer, and read once its
+	// fence has been signaled. If they didn't fit, the buffers grow and the octree is rebuilt.
+	GLuint octreeReadbackBuffer = 0;
+	const GLuint * octreeReadback = nullptr;
+	GLsync octreeReadbackFence = nullptr;
+
+	// What the octree was built from. The scene is only voxelized into the octree again when any of this has changed.
+	bool sparseVoxelOctreeQueued = true;
+	std::vector<MeshRenderer*> octreeRenderers;
+	std::vector<PointLight> octreePointLights;
+	glm::ivec4 octreeSettings = glm::ivec4(-1); // The levels, conservative voxelization, CPU voxelization and max lights.
+	float octreeLevelOfDetail = -1.0f;
+
+	void initSparseVoxelOctree();
+	void resizeSparseVoxelOctree(GLuint tiles);
+	void buildSparseVoxelOctree(Scene & renderingScene);
+	void buildSparseVoxelOctreeOnGPU(Scene & renderingScene, GLuint levels);
+	bool sparseVoxelOctreeChanged(Scene & renderingScene);
+	void checkSparseVoxelOctreeCapacity();
+	/// <summary> Reads back the fragment list and the node and brick pools, rebuilds the octree from the fragments on the CPU,
+	/// and prints how the octrees differ, along with the build time, traversal time and memory of the CPU octree. </summary>
+	void validateSparseVoxelOctree();
+
+	// ----------------
+	// Clipmap.
+	// ----------------
+	static const int MAX_CLIPMAP_CASCADES = 6; // Must match voxel_cone_tracing.frag.
+	std::vector<Texture3D*> clipmapTextures;
+	std::vector<glm::ivec3> clipmapOrigins; // Minimum corner of every cascade, in voxels of that cascade.
+	float clipmapVoxelizedExtent = 0.0f; // The clipmap extent that the cascades were voxelized with.
+	unsigned int nextClipmapCascade = 0; // The cascade that is refreshed next time the scene is voxelized.
+	void updateClipmap(Scene & renderingScene, bool voxelizeNow);
+	void voxelizeClipmapRegion(Scene & renderingScene, unsigned int cascade, glm::ivec3 updateMin, glm::ivec3 updateMax);
+	float getClipmapVoxelSize(unsigned int cascade) const;
 
 	// ----------------
 	// Voxelization visualization.
 	// ----------------
 	void initVoxelVisualization(unsigned int viewportWidth, unsigned int viewportHeight);
-	void renderVoxelVisualization(Scene & renderingScene, unsigned int viewportWidth, unsigned int viewportHeight);
+	void renderVoxelVisualization(unsigned int viewportWidth, unsigned int viewportHeight);
 	FBO *vvfbo1, *vvfbo2;
 	Material * worldPositionMaterial, *voxelVisualizationMaterial;
 	// --- Screen quad. ---
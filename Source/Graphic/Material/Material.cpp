@@ -8,6 +8,15 @@
 
 #include "Shader.h"
 
+namespace {
+	/// <summary> 64 bit FNV-1a. Cheaper than constructing a std::string, since uniforms are looked up for every draw. </summary>
+	uint64_t hashName(const char * name) {
+		uint64_t h = 14695981039346656037ull;
+		for (; *name != '\0'; ++name) { h = (h ^ (unsigned char)*name) * 1099511628211ull; }
+		return h;
+	}
+}
+
 Material::~Material()
 {
 	glDeleteProgram(program);
@@ -58,6 +67,74 @@ Material::Material(
 		glAttachShader(program, tessControlShaderID);
 	}
 
+	link();
+
+	glDeleteShader(vertexShaderID);
+	glDeleteShader(fragmentShaderID);
+	if (geometryShader != nullptr) { glDeleteShader(geometryShaderID); }
+	if (tessControlShader != nullptr) { glDeleteShader(tessControlShaderID); }
+	if (tessEvaluationShader != nullptr) { glDeleteShader(tessEvaluationShaderID); }
+}
+
+Material::Material(std::string _name, Shader * computeShader) : name(_name)
+{
+	assert(computeShader != nullptr);
+	assert(computeShader->shaderType == Shader::ShaderType::COMPUTE);
+
+	program = glCreateProgram();
+	GLuint computeShaderID = computeShader->compile();
+	glAttachShader(program, computeShaderID);
+
+	link();
+
+	glDeleteShader(computeShaderID);
+}
+
+Material::Material(std::string _name, GLuint _program) : program(_program), name(_name)
+{
+	resolveUniformLocations();
+	std::cout << "- Material '" << name << "' (program " << program << ") loaded from the program cache." << std::endl;
+}
+
+GLint Material::getUniformLocation(const char * name) const
+{
+	const auto location = uniformLocations.find(hashName(name));
+	return location != uniformLocations.end() ? location->second : -1;
+}
+
+void Material::resolveUniformLocations()
+{
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<GLchar> buffer(maxLength + 1);
+	for (GLint i = 0; i < count; ++i) {
+		GLint size;
+		GLenum type;
+		GLsizei length;
+		glGetActiveUniform(program, i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+		std::string uniform(buffer.data(), length);
+
+		// Arrays are listed once as their first element (e.g. "clipmap[0]"). Every element has its own location,
+		// and the array name on its own refers to the first element.
+		const size_t bracket = uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0 ? uniform.size() - 3 : std::string::npos;
+		if (bracket == std::string::npos) {
+			uniformLocations[hashName(uniform.c_str())] = glGetUniformLocation(program, uniform.c_str());
+			continue;
+		}
+		const std::string array = uniform.substr(0, bracket);
+		uniformLocations[hashName(array.c_str())] = glGetUniformLocation(program, uniform.c_str());
+		for (GLint element = 0; element < size; ++element) {
+			const std::string elementName = array + "[" + std::to_string(element) + "]";
+			uniformLocations[hashName(elementName.c_str())] = glGetUniformLocation(program, elementName.c_str());
+		}
+	}
+}
+
+void Material::link()
+{
+	// Lets the program be stored in the program cache (see MaterialStore::compile).
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(program);
 
 	// Check if we succeeded.
@@ -70,12 +147,7 @@ Material::Material(
 		std::cerr << "LOG: " << std::endl << log << std::endl;
 	}
 	else {
+		resolveUniformLocations();
 		std::cout << "- Material '" << name << "' (program " << program << ") sucessfully created." << std::endl;
 	}
-
-	glDeleteShader(vertexShaderID);
-	glDeleteShader(fragmentShaderID);
-	if (geometryShader != nullptr) { glDeleteShader(geometryShaderID); }
-	if (tessControlShader != nullptr) { glDeleteShader(tessControlShaderID); }
-	if (tessEvaluationShader != nullptr) { glDeleteShader(tessEvaluationShaderID); }
 }
\ No newline at end of file
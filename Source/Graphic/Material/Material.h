@@ -1,5 +1,6 @@
 #pragma once;
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
@@ -23,9 +24,28 @@ public:
 		Shader * tessEvaluationShader = nullptr,
 		Shader * tessControlShader = nullptr);
 
+	/// <summary> Creates a compute material, i.e. a program that only consists of a compute shader. </summary>
+	Material(std::string _name, Shader * computeShader);
+
+	/// <summary> Creates a material from an already linked program (e.g. loaded from the ProgramCache). Takes ownership of the program. </summary>
+	Material(std::string _name, GLuint _program);
+
 	/// <summary> The actual OpenGL / GLSL program identifier. </summary>
 	GLuint program;
 
 	/// <summary> A name. Just an identifier. Doesn't do anything practical. </summary>
 	std::string name;
+
+	/// <summary> The #defines that the shaders were compiled with (see MaterialStore::findMaterialVariant). </summary>
+	std::string defines;
+
+	/// <summary> Returns the location of a uniform (e.g. "material.emissivity" or "clipmap[2]"), or -1 if the program doesn't use it.
+	/// The locations are resolved once after linking, so unlike glGetUniformLocation this doesn't call the driver. </summary>
+	GLint getUniformLocation(const char * name) const;
+	GLint getUniformLocation(const std::string & name) const { return getUniformLocation(name.c_str()); }
+private:
+	/// <summary> The location of every active uniform and of every array element, keyed by a hash of the name. </summary>
+	std::unordered_map<uint64_t, GLint> uniformLocations;
+	void resolveUniformLocations();
+	void link();
 };
\ No newline at end of file
@@ -6,41 +6,21 @@
 #include <gtc/type_ptr.hpp>
 #include <glm.hpp>
 
-namespace {
-	const char * diffuseColorName = "material.diffuseColor";
-	const char * specularColorName = "material.specularColor";
-	const char * emissivityName = "material.emissivity";
-	const char * transparencyName = "material.transparency";
-	const char * refractiveIndexName = "material.refractiveIndex";
-	const char * specularReflectanceName = "material.specularReflectivity";
-	const char * diffuseReflectanceName = "material.diffuseReflectivity";
-	const char * specularDiffusionName = "material.specularDiffusion";
-}
-
 /// <summary> Represents a setting for a material that can be used along with voxel cone tracing GI. </summary>
 struct MaterialSetting {
 	glm::vec3 diffuseColor, specularColor = glm::vec3(1);
 	float specularReflectivity, diffuseReflectivity, emissivity, specularDiffusion = 2.0f;
 	float transparency = 0.0f, refractiveIndex = 1.4f;
 
-	void Upload(GLuint program, bool useProgram = true) {
-		if (useProgram) glUseProgram(program);
-
-		// Vec3s.
-		glUniform3fv(glGetUniformLocation(program, diffuseColorName), 1, glm::value_ptr(diffuseColor));
-		glUniform3fv(glGetUniformLocation(program, specularColorName), 1, glm::value_ptr(specularColor));
+	bool IsEmissive() { return emissivity > 0.00001f; }
 
-		// Floats.
-		glUniform1f(glGetUniformLocation(program, emissivityName), emissivity);
-		glUniform1f(glGetUniformLocation(program, specularReflectanceName), specularReflectivity);
-		glUniform1f(glGetUniformLocation(program, diffuseReflectanceName), diffuseReflectivity);
-		glUniform1f(glGetUniformLocation(program, specularDiffusionName), specularDiffusion);
-		glUniform1f(glGetUniformLocation(program, transparencyName), transparency);
-		glUniform1f(glGetUniformLocation(program, refractiveIndexName), refractiveIndex);
+	bool operator==(const MaterialSetting & other) const {
+		return diffuseColor == other.diffuseColor && specularColor == other.specularColor &&
+			specularReflectivity == other.specularReflectivity && diffuseReflectivity == other.diffuseReflectivity &&
+			emissivity == other.emissivity && specularDiffusion == other.specularDiffusion &&
+			transparency == other.transparency && refractiveIndex == other.refractiveIndex;
 	}
 
-	bool IsEmissive() { return emissivity > 0.00001f; }
-
 	// Basic constructor.
 	MaterialSetting(
 		glm::vec3 _diffuseColor = glm::vec3(1),
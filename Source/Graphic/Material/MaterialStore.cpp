@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "Material.h"
+#include "ProgramCache.h"
 #include "Shader.h"
 
 MaterialStore::MaterialStore()
@@ -10,41 +11,102 @@ MaterialStore::MaterialStore()
 	// Voxelization.
 	AddNewMaterial("voxelization", "Voxelization\\voxelization.vert", "Voxelization\\voxelization.frag", "Voxelization\\voxelization.geom");
 
+	AddNewComputeMaterial("average_voxels", "Voxelization\\average_voxels.comp");
+	AddNewComputeMaterial("inject_light", "Voxelization\\inject_light.comp");
+	AddNewComputeMaterial("build_octree", "Voxelization\\build_octree.comp");
+
+	// Voxel mipmapping.
+	AddNewComputeMaterial("mipmap", "Voxelization\\mipmap.comp");
+	AddNewComputeMaterial("anisotropic_mipmap", "Voxelization\\anisotropic_mipmap.comp");
+
 	// Voxelization visualization.
 	AddNewMaterial("voxel_visualization", "Voxelization\\Visualization\\voxel_visualization.vert", "Voxelization\\Visualization\\voxel_visualization.frag");
 	AddNewMaterial("world_position", "Voxelization\\Visualization\\world_position.vert", "Voxelization\\Visualization\\world_position.frag");
 
 	// Cone tracing.
 	AddNewMaterial("voxel_cone_tracing", "Voxel Cone Tracing\\voxel_cone_tracing.vert", "Voxel Cone Tracing\\voxel_cone_tracing.frag");
+
+	// Deferred cone tracing.
+	AddNewMaterial("gbuffer", "Voxel Cone Tracing\\voxel_cone_tracing.vert", "Voxel Cone Tracing\\gbuffer.frag");
+	AddNewMaterial("voxel_cone_tracing_deferred", "Voxel Cone Tracing\\deferred.vert", "Voxel Cone Tracing\\voxel_cone_tracing.frag");
 }
 
 void MaterialStore::AddNewMaterial(
 	std::string name, const char * vertexPath, const char * fragmentPath,
 	const char * geometryPath, const char * tessEvalPath, const char * tessCtrlPath)
 {
-	// std::cout << vertexPath << ", " << fragmentPath << ", " << geometryPath << ", " << (tessEvalPath == nullptr) << ", " << (tessCtrlPath == nullptr) << std:: endl;
+	MaterialSource & source = sources[name];
+	if (vertexPath) { source.vertexPath = vertexPath; }
+	if (fragmentPath) { source.fragmentPath = fragmentPath; }
+	if (geometryPath) { source.geometryPath = geometryPath; }
+	if (tessEvalPath) { source.tessEvalPath = tessEvalPath; }
+	if (tessCtrlPath) { source.tessCtrlPath = tessCtrlPath; }
+}
+
+void MaterialStore::AddNewComputeMaterial(std::string name, const char * computePath)
+{
+	sources[name].computePath = computePath;
+}
+
+Material * MaterialStore::compile(const std::string & name, const MaterialSource & source, const std::string & defines) const
+{
 	using ST = Shader::ShaderType;
-	Shader *v, *f, *g, *te, *tc;
-	v = f = g = te = tc = nullptr;
 	const std::string shaderPath = "Shaders\\";
-	if (vertexPath) { v = new Shader(shaderPath + vertexPath, ST::VERTEX); }
-	if (fragmentPath) { f = new Shader(shaderPath + fragmentPath, ST::FRAGMENT); }
-	if (geometryPath) { g = new Shader(shaderPath + geometryPath, ST::GEOMETRY); }
-	if (tessEvalPath) { te = new Shader(shaderPath + tessEvalPath, ST::TESSELATION_EVALUATION); }
-	if (tessCtrlPath) { tc = new Shader(shaderPath + tessCtrlPath, ST::TESSELATION_CONTROL); }
-	materials.push_back(new Material(name, v, f, g, te, tc));
-	delete v, f, g, te, tc;
+	Shader *v, *f, *g, *te, *tc, *c;
+	v = f = g = te = tc = c = nullptr;
+	if (!source.computePath.empty()) { c = new Shader(shaderPath + source.computePath, ST::COMPUTE, defines); }
+	if (!source.vertexPath.empty()) { v = new Shader(shaderPath + source.vertexPath, ST::VERTEX, defines); }
+	if (!source.fragmentPath.empty()) { f = new Shader(shaderPath + source.fragmentPath, ST::FRAGMENT, defines); }
+	if (!source.geometryPath.empty()) { g = new Shader(shaderPath + source.geometryPath, ST::GEOMETRY, defines); }
+	if (!source.tessEvalPath.empty()) { te = new Shader(shaderPath + source.tessEvalPath, ST::TESSELATION_EVALUATION, defines); }
+	if (!source.tessCtrlPath.empty()) { tc = new Shader(shaderPath + source.tessCtrlPath, ST::TESSELATION_CONTROL, defines); }
+
+	// Use the cached program binary if the sources (and the driver) haven't changed since it was stored.
+	std::vector<std::string> sources;
+	for (Shader * shader : { c, v, f, g, te, tc }) {
+		sources.push_back(shader ? shader->getSource() : "");
+	}
+	const std::string key = ProgramCache::key(sources);
+	Material * material;
+	const GLuint program = ProgramCache::load(key);
+	if (program != 0) {
+		material = new Material(name, program);
+	}
+	else {
+		material = c ? new Material(name, c) : new Material(name, v, f, g, te, tc);
+		ProgramCache::store(key, material->program);
+	}
+	delete c; delete v; delete f; delete g; delete te; delete tc;
+	material->defines = defines;
+	return material;
 }
 
 Material * MaterialStore::findMaterialWithName(std::string name)
 {
-	for (unsigned int i = 0; i < materials.size(); ++i) {
-		if (materials[i]->name == name) {
-			return materials[i];
-		}
+	return findMaterialVariant(name, "");
+}
+
+Material * MaterialStore::findMaterialVariant(std::string name, const std::string & defines)
+{
+	// Variants are selected every frame, so they're looked up by hash.
+	const std::string key = name + "\n" + defines;
+	const auto variant = variants.find(key);
+	if (variant != variants.end()) return variant->second;
+
+	// Compile the material (variant) on first use.
+	const auto source = sources.find(name);
+	if (source == sources.end()) {
+		std::cerr << "Couldn't find material with name " << name << std::endl;
+		return nullptr;
 	}
-	std::cerr << "Couldn't find material with name " << name << std::endl;
-	return nullptr;
+	materials.push_back(compile(name, source->second, defines));
+	variants[key] = materials.back();
+	return materials.back();
+}
+
+Material * MaterialStore::findMaterialVariant(std::string name, const ShaderDefines & defines)
+{
+	return findMaterialVariant(name, defines.toString());
 }
 
 Material * MaterialStore::findMaterialWithProgramID(unsigned int programID)
@@ -1,22 +1,43 @@
 #pragma once
 
+#include <string>
 #include <vector>
+#include <unordered_map>
+
+#include "ShaderDefines.h"
 
 class Material;
 
-/// <summary> Manages all loaded materials and shader programs. </summary>
+/// <summary> Manages all loaded materials and shader programs.
+/// Materials are compiled on first use, and a material can be compiled in several variants with different #defines.
+/// Linked programs are cached on disk (see ProgramCache), so later runs only compile materials whose shaders changed. </summary>
 class MaterialStore {
 public:
 	static MaterialStore& getInstance();
 	std::vector<Material*> materials;
 	Material * MaterialStore::findMaterialWithName(std::string name);
 	Material * MaterialStore::findMaterialWithProgramID(unsigned int programID);
+
+	/// <summary> Returns the variant of a material whose shaders are compiled with the given defines
+	/// (e.g. "#define DIFFUSE_CONES 5\n"). The variant is compiled the first time it's requested. </summary>
+	Material * MaterialStore::findMaterialVariant(std::string name, const std::string & defines);
+	Material * MaterialStore::findMaterialVariant(std::string name, const ShaderDefines & defines);
+
 	void AddNewMaterial(
 		std::string name, const char * vertexPath = nullptr, const char * fragmentPath = nullptr,
 		const char * geometryPath = nullptr, const char * tessEvalPath = nullptr, const char * tessCtrlPath = nullptr);
+	void AddNewComputeMaterial(std::string name, const char * computePath);
 	~MaterialStore();
 private:
+	/// <summary> The shader paths of a material, relative to the shader folder. Unused stages are empty. </summary>
+	struct MaterialSource {
+		std::string vertexPath, fragmentPath, geometryPath, tessEvalPath, tessCtrlPath, computePath;
+	};
+	std::unordered_map<std::string, MaterialSource> sources;
+	std::unordered_map<std::string, Material*> variants; // Compiled materials, keyed by name and defines.
+	Material * compile(const std::string & name, const MaterialSource & source, const std::string & defines) const;
+
 	MaterialStore();
 	MaterialStore(MaterialStore const &) = delete;
 	void operator=(MaterialStore const &) = delete;
-};
\ No newline at end of file
+};
@@ -0,0 +1,96 @@
+#include "ProgramCache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "../../Utility/Directory.h"
+
+const char * ProgramCache::CACHE_PATH = "Shaders/Cache/";
+
+namespace {
+	/// <summary> 64 bit FNV-1a. Unlike std::hash, it's the same for every build, so keys stay valid between runs. </summary>
+	uint64_t hash(const std::string & s, uint64_t h = 14695981039346656037ull) {
+		for (unsigned char c : s) { h = (h ^ c) * 1099511628211ull; }
+		return h;
+	}
+
+	std::string getString(GLenum name) {
+		const GLubyte * s = glGetString(name);
+		return s ? std::string((const char *)s) : std::string();
+	}
+
+	/// <summary> Program binaries are only supported if the driver has at least one binary format. </summary>
+	bool isSupported() {
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+}
+
+std::string ProgramCache::key(const std::vector<std::string> & sources)
+{
+	// Binaries are driver specific, so the driver is part of the key.
+	uint64_t h = hash(getString(GL_VENDOR) + "\n" + getString(GL_RENDERER) + "\n" + getString(GL_VERSION));
+	for (const auto & source : sources) {
+		h = hash(source, hash("\n", h));
+	}
+	char key[17];
+	std::snprintf(key, sizeof(key), "%016llx", (unsigned long long)h);
+	return key;
+}
+
+GLuint ProgramCache::load(const std::string & key)
+{
+	if (!isSupported()) return 0;
+	std::ifstream file(CACHE_PATH + key + ".bin", std::ios::in | std::ios::binary);
+	if (!file.is_open()) return 0;
+
+	GLenum format;
+	std::vector<char> binary;
+	file.read((char *)&format, sizeof(format));
+	file.seekg(0, std::ios::end);
+	const std::streamoff size = (std::streamoff)file.tellg() - (std::streamoff)sizeof(format);
+	if (!file || size <= 0) return 0;
+	binary.resize((size_t)size);
+	file.seekg(sizeof(format), std::ios::beg);
+	file.read(binary.data(), size);
+	if (!file) return 0;
+
+	// The driver may reject a binary (e.g. if it has been updated without changing the version string).
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+	GLint success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void ProgramCache::store(const std::string & key, GLuint program)
+{
+	if (!isSupported()) return;
+	GLint success, length;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (!success || length <= 0) return;
+
+	GLenum format;
+	std::vector<char> binary(length);
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	static bool folderCreated = false;
+	if (!folderCreated && !(folderCreated = Directory::create(CACHE_PATH))) {
+		static bool reported = false;
+		if (!reported) std::cerr << "Could not create the program cache folder '" << CACHE_PATH << "'. Programs will not be cached." << std::endl;
+		reported = true;
+		return;
+	}
+	std::ofstream file(CACHE_PATH + key + ".bin", std::ios::out | std::ios::binary);
+	if (!file.is_open()) return;
+	file.write((const char *)&format, sizeof(format));
+	file.write(binary.data(), length);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#define GLEW_STATIC
+#include <glew.h>
+#include <glfw3.h>
+
+/// <summary> Caches linked programs on disk (see glGetProgramBinary), so that materials don't have to be compiled
+/// from source every time the application starts. A program is keyed by a hash of its shader sources (including
+/// the defines) and the driver, i.e. editing a shader or updating the driver makes the cached binary unused. </summary>
+class ProgramCache {
+public:
+	/// <summary> The folder that the program binaries are stored in. Created when the first program is stored. </summary>
+	static const char * CACHE_PATH;
+
+	/// <summary> Returns the key of a program that is linked from the given shader sources. </summary>
+	static std::string key(const std::vector<std::string> & sources);
+
+	/// <summary> Creates a program from the binary stored with the given key.
+	/// Returns 0 if there is no such binary or if the driver rejects it. </summary>
+	static GLuint load(const std::string & key);
+
+	/// <summary> Stores the binary of a successfully linked program with the given key. </summary>
+	static void store(const std::string & key, GLuint program);
+};
@@ -33,7 +33,7 @@ GLuint Shader::compile() {
 	return id;
 }
 
-Shader::Shader(std::string _path, ShaderType _type) : path(_path), shaderType(_type) {
+Shader::Shader(std::string _path, ShaderType _type, const std::string & defines) : path(_path), shaderType(_type) {
 	// Load the shader instantly.
 	std::ifstream fileStream(path, std::ios::in);
 	if (!fileStream.is_open()) {
@@ -48,6 +48,12 @@ Shader::Shader(std::string _path, ShaderType _type) : path(_path), shaderType(_t
 		rawShader.append(line + "\n");
 	}
 	fileStream.close();
+
+	// The #version directive must come first, so the defines are inserted after it.
+	if (defines.empty()) return;
+	const size_t version = rawShader.find("#version");
+	const size_t insertAt = version == std::string::npos ? 0 : rawShader.find('\n', version) + 1;
+	rawShader.insert(insertAt, defines);
 }
 
 std::string Shader::GetShaderTypeName()
@@ -58,6 +64,7 @@ std::string Shader::GetShaderTypeName()
 	case ShaderType::GEOMETRY:					return "geometry";
 	case ShaderType::TESSELATION_CONTROL:		return "tesselation control";
 	case ShaderType::TESSELATION_EVALUATION:	return "tesselation evaluation";
+	case ShaderType::COMPUTE:					return "compute";
 	default:									return "unknown";
 	}
 }
\ No newline at end of file
@@ -14,7 +14,8 @@ public:
 		FRAGMENT = GL_FRAGMENT_SHADER,
 		GEOMETRY = GL_GEOMETRY_SHADER,
 		TESSELATION_EVALUATION = GL_TESS_EVALUATION_SHADER,
-		TESSELATION_CONTROL = GL_TESS_CONTROL_SHADER
+		TESSELATION_CONTROL = GL_TESS_CONTROL_SHADER,
+		COMPUTE = GL_COMPUTE_SHADER
 	};
 
 	ShaderType shaderType;
@@ -28,8 +29,12 @@ public:
 	/// <summary> Compiles the shader. Returns the OpenGL shader ID. </summary>
 	GLuint compile();
 
-	/// <summary> Creates and loads a shader from disk. Does not compile it. </summary>
-	Shader(std::string path, ShaderType shaderType);
+	/// <summary> The shader source, including the inserted defines. </summary>
+	const std::string & getSource() const { return rawShader; }
+
+	/// <summary> Creates and loads a shader from disk. Does not compile it.
+	/// The defines (e.g. "#define SHADOWS 0\n") are inserted after the #version directive. </summary>
+	Shader(std::string path, ShaderType shaderType, const std::string & defines = "");
 private:
 	std::string rawShader;
 	Shader();
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+/// <summary> A set of #defines that selects a permutation of a material's shaders (see MaterialStore::findMaterialVariant).
+/// The defines are sorted by name, so that the same settings always give the same permutation. </summary>
+class ShaderDefines {
+public:
+	/// <summary> Sets a define. Booleans become 0 or 1, so that they can be tested using #if. </summary>
+	ShaderDefines & set(const std::string & name, int value) { defines[name] = value; return *this; }
+
+	/// <summary> Returns the #define directives, one per line. </summary>
+	std::string toString() const {
+		std::string directives;
+		for (const auto & define : defines) directives += "#define " + define.first + " " + std::to_string(define.second) + "\n";
+		return directives;
+	}
+private:
+	std::map<std::string, int> defines;
+};
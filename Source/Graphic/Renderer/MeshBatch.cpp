@@ -0,0 +1,70 @@
+#include "MeshBatch.h"
+
+#include <numeric>
+#include <algorithm>
+#include <cstddef>
+
+#include "../../Shape/Mesh.h"
+#include "MeshRenderer.h"
+
+const MeshBatch::Range & MeshBatch::getRange(const Mesh * mesh, unsigned int levelOfDetail)
+{
+	const auto range = ranges.find(mesh);
+	if (range != ranges.end()) return range->second[levelOfDetail];
+
+	// Indices stay relative to the mesh, since every draw command has a base vertex. All levels share the vertices.
+	auto & added = ranges[mesh];
+	for (unsigned int level = 0; level <= mesh->levelsOfDetail.size(); ++level) {
+		const auto & levelIndices = mesh->getIndices(level);
+		added.push_back({ (GLuint)levelIndices.size(), (GLuint)indices.size(), (GLint)vertexData.size() });
+		indices.insert(indices.end(), levelIndices.begin(), levelIndices.end());
+	}
+	mesh->packVertexData(vertexData);
+	meshesAdded = true;
+	return added[levelOfDetail];
+}
+
+void MeshBatch::bind(GLuint numberOfDraws)
+{
+	if (vao == 0) {
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+		glGenBuffers(1, &ebo);
+		glGenBuffers(1, &drawIndexBuffer);
+		glBindVertexArray(vao);
+
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		MeshRenderer::setupPackedVertexAttributes();
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	}
+	glBindVertexArray(vao);
+
+	// The meshes are re-uploaded as a whole, which only happens when renderers are drawn for the first time.
+	if (meshesAdded) {
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(PackedVertexData), vertexData.data(), GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+		meshesAdded = false;
+	}
+
+	// Draw index i is stored at i, so that instance 0 of a draw command with base instance i reads i.
+	if (numberOfDraws > drawIndices) {
+		drawIndices = std::max(numberOfDraws, 2 * drawIndices);
+		std::vector<GLuint> drawIndexData(drawIndices);
+		std::iota(drawIndexData.begin(), drawIndexData.end(), 0);
+		glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, drawIndices * sizeof(GLuint), drawIndexData.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(2);
+		glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(GLuint), 0);
+		glVertexAttribDivisor(2, 1);
+	}
+}
+
+MeshBatch::~MeshBatch()
+{
+	if (vao == 0) return;
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ebo);
+	glDeleteBuffers(1, &drawIndexBuffer);
+	glDeleteVertexArrays(1, &vao);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#define GLEW_STATIC
+#include <glew.h>
+#include <glfw3.h>
+
+#include "../../Shape/VertexData.h"
+
+class Mesh;
+
+/// <summary> Packs static meshes into shared vertex and index buffers, so that they can all be drawn using
+/// a single glMultiDrawElementsIndirect (see Graphics::renderQueue). Meshes are added the first time they are drawn,
+/// and are expected not to change afterwards (see Mesh::staticMesh). The vertices are packed (see Mesh::packedVertexData). </summary>
+class MeshBatch {
+public:
+	/// <summary> Where a mesh is stored in the shared buffers, i.e. the mesh's part of a draw command. </summary>
+	struct Range {
+		GLuint count, firstIndex;
+		GLint baseVertex;
+	};
+
+	/// <summary> Returns where a level of detail of a mesh is stored, adding the mesh (and all of its levels of detail)
+	/// to the batch if it hasn't been drawn before. </summary>
+	const Range & getRange(const Mesh * mesh, unsigned int levelOfDetail = 0);
+
+	/// <summary> Binds the vertex array of the batch, uploading the meshes that have been added since the previous call.
+	/// Attribute 2 is the draw index, which is read per instance, i.e. it's the base instance of every draw command. </summary>
+	void bind(GLuint numberOfDraws);
+
+	~MeshBatch();
+private:
+	std::unordered_map<const Mesh *, std::vector<Range>> ranges; // Per level of detail.
+	std::vector<PackedVertexData> vertexData;
+	std::vector<GLuint> indices;
+	bool meshesAdded = false;
+	GLuint drawIndices = 0; // The number of draw indices in drawIndexBuffer.
+	GLuint vao = 0, vbo = 0, ebo = 0, drawIndexBuffer = 0;
+};
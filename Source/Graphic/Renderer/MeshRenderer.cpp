@@ -20,6 +20,8 @@ MeshRenderer::MeshRenderer(Mesh * _mesh, MaterialSetting * _materialSetting) : m
 
 	mesh = _mesh;
 
+	mesh->getBounds(meshBoundsMin, meshBoundsMax);
+
 	setupMeshRenderer();
 }
 
@@ -46,23 +48,70 @@ MeshRenderer::~MeshRenderer()
 	if (materialSetting != nullptr) delete materialSetting;
 }
 
-void MeshRenderer::render(const GLuint program)
+void MeshRenderer::render(const Material * material, const glm::mat4 & M, unsigned int levelOfDetail)
 {
-	
-	glUniformMatrix4fv(glGetUniformLocation(program, MODEL_MATRIX_NAME), 1, GL_FALSE, glm::value_ptr(transform.getTransformMatrix()));
+	// The levels of detail are stored after the mesh in the element buffer.
+	size_t firstIndex = 0;
+	for (unsigned int level = 0; level < levelOfDetail; ++level) firstIndex += mesh->getIndices(level).size();
+	glUniformMatrix4fv(material->getUniformLocation(MODEL_MATRIX_NAME), 1, GL_FALSE, glm::value_ptr(M * mesh->dequantizationMatrix));
 	glBindVertexArray(mesh->vao);
-	glDrawElements(GL_TRIANGLES, mesh->indices.size(), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, mesh->getIndices(levelOfDetail).size(), GL_UNSIGNED_INT, (GLvoid*)(firstIndex * sizeof(GLuint)));
+}
+
+void MeshRenderer::updateDirtyState()
+{
+	const MaterialSetting currentMaterialSetting = materialSetting != nullptr ? *materialSetting : MaterialSetting();
+	dirty = enabled != previousEnabled || transform.getTransformMatrix() != previousTransformMatrix || !(currentMaterialSetting == previousMaterialSetting);
+	previousEnabled = enabled;
+	previousTransformMatrix = transform.getTransformMatrix();
+	previousMaterialSetting = currentMaterialSetting;
+}
+
+void MeshRenderer::getWorldBounds(glm::vec3 & min, glm::vec3 & max)
+{
+	const glm::mat4 & M = transform.getTransformMatrix();
+	for (unsigned int i = 0; i < 8; ++i) {
+		const glm::vec3 corner = glm::mix(meshBoundsMin, meshBoundsMax, glm::vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+		const glm::vec3 p = glm::vec3(M * glm::vec4(corner, 1.0f));
+		min = i == 0 ? p : glm::min(min, p);
+		max = i == 0 ? p : glm::max(max, p);
+	}
 }
 
 void MeshRenderer::reuploadIndexDataToGPU()
 {
 	glBindVertexArray(mesh->vao);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->indices.size() * sizeof(GLuint), mesh->indices.data(), mesh->staticMesh ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+	size_t numberOfIndices = 0, firstIndex = 0;
+	for (unsigned int level = 0; level <= mesh->levelsOfDetail.size(); ++level) numberOfIndices += mesh->getIndices(level).size();
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numberOfIndices * sizeof(GLuint), nullptr, mesh->staticMesh ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+	for (unsigned int level = 0; level <= mesh->levelsOfDetail.size(); ++level) {
+		const auto & indices = mesh->getIndices(level);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, firstIndex * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+		firstIndex += indices.size();
+	}
+}
+
+void MeshRenderer::setPackedVertexData(bool packed)
+{
+	if (mesh->packedVertexData == packed) return;
+	mesh->packedVertexData = packed;
+	reuploadVertexDataToGPU();
 }
 
 void MeshRenderer::reuploadVertexDataToGPU()
 {
+	if (mesh->packedVertexData) {
+		std::vector<PackedVertexData> packed;
+		mesh->dequantizationMatrix = mesh->packVertexData(packed);
+		glBindVertexArray(mesh->vao);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+		glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertexData), packed.data(), mesh->staticMesh ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+		setupPackedVertexAttributes();
+		return;
+	}
+
+	mesh->dequantizationMatrix = glm::mat4(1.0f);
 	auto dataSize = sizeof(VertexData);
 	glBindVertexArray(mesh->vao);
 	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
@@ -72,3 +121,12 @@ void MeshRenderer::reuploadVertexDataToGPU()
 	glEnableVertexAttribArray(1); // Normals.
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, dataSize, (GLvoid*)offsetof(VertexData, VertexData::normal));
 }
+
+void MeshRenderer::setupPackedVertexAttributes()
+{
+	auto dataSize = sizeof(PackedVertexData);
+	glEnableVertexAttribArray(0); // Positions.
+	glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, dataSize, 0);
+	glEnableVertexAttribArray(1); // Normals.
+	glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, dataSize, (GLvoid*)offsetof(PackedVertexData, PackedVertexData::normal));
+}
@@ -10,6 +10,7 @@
 #include <glm.hpp>
 
 class Mesh;
+class Material;
 
 /// <summary> A renderer that can be used to render a mesh. </summary>
 class MeshRenderer {
@@ -27,8 +28,31 @@ public:
 
 	// Rendering.
 	MaterialSetting * materialSetting = nullptr;
-	void render(const GLuint program);
+	void render(const Material * material) { render(material, transform.getTransformMatrix()); }
+	/// <summary> Renders the mesh using a world matrix that has already been calculated (see Graphics::updateRenderers),
+	/// at a level of detail of the mesh (see Mesh::levelsOfDetail). </summary>
+	void render(const Material * material, const glm::mat4 & M, unsigned int levelOfDetail = 0);
+
+	/// <summary> Is true if the transform, the material setting or enabled changed between the two latest calls to updateDirtyState.
+	/// Used by incremental voxelization to find renderers that have to be re-voxelized. </summary>
+	bool dirty = true;
+
+	/// <summary> Compares the transform, the material setting and enabled with their state at the previous call, and updates dirty. </summary>
+	void updateDirtyState();
+
+	/// <summary> Returns the world space bounding box of the mesh (using the current transform matrix). </summary>
+	void getWorldBounds(glm::vec3 & min, glm::vec3 & max);
+
+	/// <summary> Re-uploads the vertices of the mesh if they aren't in the given format (see Mesh::packedVertexData). </summary>
+	void setPackedVertexData(bool packed);
+
+	/// <summary> Sets up the attributes of the bound vertex array for the bound buffer of packed vertices (see PackedVertexData). </summary>
+	static void setupPackedVertexAttributes();
 private:
+	glm::vec3 meshBoundsMin, meshBoundsMax; // The bounding box of the mesh in model space.
+	bool previousEnabled = true;
+	glm::mat4 previousTransformMatrix;
+	MaterialSetting previousMaterialSetting;
 	void setupMeshRenderer();
 	void reuploadIndexDataToGPU();
 	void reuploadVertexDataToGPU();
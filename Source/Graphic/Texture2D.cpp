@@ -2,6 +2,8 @@
 
 #include <iostream>
 
+#include "Material/Material.h"
+
 Texture2D::Texture2D(
 	const std::string _shaderTextureName,
 	const std::string path,
@@ -49,9 +51,9 @@ Texture2D::~Texture2D()
 	glDeleteTextures(1, &textureID);
 }
 
-void Texture2D::Activate(int shaderProgram, int textureUnit)
+void Texture2D::Activate(const Material * material, int textureUnit)
 {
 	glActiveTexture(textureUnit);
 	glBindTexture(GL_TEXTURE_2D, textureID);
-	glUniform1i(glGetUniformLocation(shaderProgram, shaderTextureSamplerName.c_str()), textureUnit);
+	glUniform1i(material->getUniformLocation(shaderTextureSamplerName), textureUnit);
 }
\ No newline at end of file
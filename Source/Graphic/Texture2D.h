@@ -7,6 +7,8 @@
 #include <glfw3.h>
 #include <SOIL\SOIL.h>
 
+class Material;
+
 /// <summary> A 2D texture wrapper class. Handles important OpenGL calls. </summary>
 class Texture2D {
 public:
@@ -14,7 +16,7 @@ public:
 	GLuint textureID;
 
 	/// <summary> Activates this texture and passes it on to a texture unit on the GPU. </summary>
-	void Activate(int shaderProgram, int textureUnit = 0);
+	void Activate(const Material * material, int textureUnit = 0);
 
 	Texture2D(const std::string shaderTextureSamplerName, const std::string path, const bool generateMipmaps = true, const int force_channels = SOIL_LOAD_RGB);
 	~Texture2D();
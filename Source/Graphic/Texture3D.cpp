@@ -1,16 +1,18 @@
 #include "Texture3D.h"
 
 #include <vector>
+#include <algorithm>
 
-Texture3D::Texture3D(const std::vector<GLfloat> & textureBuffer, const int _width, const int _height, const int _depth, const bool generateMipmaps) :
-	width(_width), height(_height), depth(_depth), clearData(4 * _width * _height * _depth, 0.0f)
+#include "Material/Material.h"
+
+Texture3D::Texture3D(const std::vector<GLfloat> & textureBuffer, const int _width, const int _height, const int _depth, const bool generateMipmaps, const GLint wrap) :
+	width(_width), height(_height), depth(_depth)
 {
 	// Generate texture on GPU.
 	glGenTextures(1, &textureID);
 	glBindTexture(GL_TEXTURE_3D, textureID);
 
 	// Parameter options.
-	const auto wrap = GL_CLAMP_TO_BORDER;
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, wrap);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, wrap);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, wrap);
@@ -19,19 +21,34 @@ Texture3D::Texture3D(const std::vector<GLfloat> & textureBuffer, const int _widt
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, filter);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	// Upload texture buffer.
-	const int levels = 7;
+	// Allocate a full mipmap chain (down to 1x1x1) and upload the texture buffer.
+	int levels = 1;
+	while ((std::max({ width, height, depth }) >> levels) > 0) ++levels;
 	glTexStorage3D(GL_TEXTURE_3D, levels, GL_RGBA8, width, height, depth);
-	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, width, height, depth, 0, GL_RGBA, GL_FLOAT, &textureBuffer[0]);
-	if (generateMipmaps) glGenerateMipmap(GL_TEXTURE_3D);
+	if (textureBuffer.empty()) {
+		for (int level = 0; level < levels; ++level) glClearTexImage(textureID, level, GL_RGBA, GL_FLOAT, nullptr);
+	}
+	else {
+		glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, width, height, depth, GL_RGBA, GL_FLOAT, &textureBuffer[0]);
+		if (generateMipmaps) glGenerateMipmap(GL_TEXTURE_3D);
+	}
 	glBindTexture(GL_TEXTURE_3D, 0);
 }
 
-void Texture3D::Activate(const int shaderProgram, const std::string glSamplerName, const int textureUnit)
+void Texture3D::Activate(const Material * material, const std::string & glSamplerName, const int textureUnit)
 {
 	glActiveTexture(GL_TEXTURE0 + textureUnit);
 	glBindTexture(GL_TEXTURE_3D, textureID);
-	glUniform1i(glGetUniformLocation(shaderProgram, glSamplerName.c_str()), textureUnit);
+	glUniform1i(material->getUniformLocation(glSamplerName), textureUnit);
+}
+
+void Texture3D::Upload(const std::vector<unsigned char> & textureBuffer, const int level)
+{
+	GLint previousBoundTextureID;
+	glGetIntegerv(GL_TEXTURE_BINDING_3D, &previousBoundTextureID);
+	glBindTexture(GL_TEXTURE_3D, textureID);
+	glTexSubImage3D(GL_TEXTURE_3D, level, 0, 0, 0, std::max(width >> level, 1), std::max(height >> level, 1), std::max(depth >> level, 1), GL_RGBA, GL_UNSIGNED_BYTE, textureBuffer.data());
+	glBindTexture(GL_TEXTURE_3D, previousBoundTextureID);
 }
 
 void Texture3D::Clear(GLfloat clearColor[4])
@@ -39,6 +56,16 @@ void Texture3D::Clear(GLfloat clearColor[4])
 	GLint previousBoundTextureID;
 	glGetIntegerv(GL_TEXTURE_BINDING_3D, &previousBoundTextureID);
 	glBindTexture(GL_TEXTURE_3D, textureID);
-	glClearTexImage(textureID, 0, GL_RGBA, GL_FLOAT, &clearColor);
+	glClearTexImage(textureID, 0, GL_RGBA, GL_FLOAT, clearColor);
 	glBindTexture(GL_TEXTURE_3D, previousBoundTextureID);
+}
+
+void Texture3D::Clear(GLfloat clearColor[4], int x, int y, int z, int w, int h, int d)
+{
+	glClearTexSubImage(textureID, 0, x, y, z, w, h, d, GL_RGBA, GL_FLOAT, clearColor);
+}
+
+Texture3D::~Texture3D()
+{
+	glDeleteTextures(1, &textureID);
 }
\ No newline at end of file
@@ -7,24 +7,32 @@
 #include <glfw3.h>
 #include <SOIL\SOIL.h>
 
+class Material;
+
 /// <summary> A 3D texture wrapper class. Handles important OpenGL calls. </summary>
 class Texture3D {
 public:
 	unsigned char * textureBuffer = nullptr;
 	GLuint textureID;
+	int width, height, depth;
 
 	/// <summary> Activates this texture and passes it on to a texture unit on the GPU. </summary>
-	void Activate(const int shaderProgram, const std::string glSamplerName, const int textureUnit = GL_TEXTURE0);
+	void Activate(const Material * material, const std::string & glSamplerName, const int textureUnit = GL_TEXTURE0);
 
 	/// <summary> Clears this texture using a given clear color. </summary>
 	void Clear(GLfloat clearColor[4]);
 
+	/// <summary> Clears a box (offset and size in texels) of the base level of this texture using a given clear color. </summary>
+	void Clear(GLfloat clearColor[4], int x, int y, int z, int w, int h, int d);
+
+	/// <summary> Uploads RGBA8 data (4 bytes per texel) to a level of this texture (the base level by default). </summary>
+	void Upload(const std::vector<unsigned char> & textureBuffer, const int level = 0);
+
+	/// <summary> Allocates a texture with a full mipmap chain. If the texture buffer is empty, the texture is cleared to 0 instead. </summary>
 	Texture3D(
 		const std::vector<GLfloat> & textureBuffer,
 		const int width, const int height, const int depth,
-		const bool generateMipmaps = true
+		const bool generateMipmaps = true, const GLint wrap = GL_CLAMP_TO_BORDER
 	);
-private:
-	int width, height, depth;
-	std::vector<GLfloat> clearData;
+	~Texture3D();
 };
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "CPUVoxelizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../../Scene/Scene.h"
+#include "../../Shape/Mesh.h"
+#include "../Renderer/MeshRenderer.h"
+#include "../Material/MaterialSetting.h"
+
+namespace {
+	// Must match the settings in voxelization.frag.
+	const unsigned int MAX_LIGHTS = 1;
+	const float POINT_LIGHT_INTENSITY = 1.0f;
+	const float DIST_FACTOR = 1.1f, CONSTANT = 1.0f, LINEAR = 0.0f, QUADRATIC = 1.0f;
+
+	float attenuate(float dist) { dist *= DIST_FACTOR; return 1.0f / (CONSTANT + LINEAR * dist + QUADRATIC * dist * dist); }
+
+	bool isInsideCube(const glm::vec3 & p) { return std::abs(p.x) < 1 && std::abs(p.y) < 1 && std::abs(p.z) < 1; }
+
+	unsigned char toUnorm8(float v) { return (unsigned char)(glm::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f); }
+
+	/// <summary> Splits [0, count) into one contiguous range per thread and runs f(thread, begin, end) in parallel. </summary>
+	template<typename F> void parallelFor(unsigned int count, unsigned int threads, F f) {
+		std::vector<std::thread> workers;
+		const unsigned int chunk = (count + threads - 1) / threads;
+		for (unsigned int t = 0; t < threads; ++t) {
+			const unsigned int begin = std::min(count, t * chunk), end = std::min(count, begin + chunk);
+			workers.emplace_back(f, t, begin, end);
+		}
+		for (auto & w : workers) w.join();
+	}
+}
+
+void CPUVoxelizer::voxelize(Scene & scene)
+{
+	unsigned int threads = numberOfThreads > 0 ? numberOfThreads : std::thread::hardware_concurrency();
+	threads = std::max(threads, 1u);
+
+	if (fragmentList) std::vector<unsigned char>().swap(voxels);
+	else voxels.assign(4 * size_t(voxelTextureSize) * voxelTextureSize * voxelTextureSize, 0);
+	fragments.clear();
+
+	gatherTriangles(scene);
+	binTriangles(threads);
+	binFragments.assign(fragmentList ? bins.size() : 0, std::vector<SparseVoxelOctree::Fragment>());
+
+	// Every voxel belongs to exactly one bin, so bins can be voxelized in parallel without synchronization.
+	std::atomic<unsigned int> nextBin(0);
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < threads; ++t) {
+		workers.emplace_back([&]() {
+			for (unsigned int bin = nextBin++; bin < bins.size(); bin = nextBin++) voxelizeBin(scene, bin);
+		});
+	}
+	for (auto & w : workers) w.join();
+
+	// The fragments are concatenated in bin order, so the list is independent of the number of threads as well.
+	for (auto & list : binFragments) fragments.insert(fragments.end(), list.begin(), list.end());
+	binFragments.clear();
+}
+
+void CPUVoxelizer::gatherTriangles(Scene & scene)
+{
+	struct Batch { MeshRenderer * renderer; unsigned int firstTriangle; };
+	std::vector<Batch> batches;
+	unsigned int numberOfTriangles = 0;
+
+	materialSettings.clear();
+	for (auto * renderer : scene.renderers) {
+		if (!renderer->enabled) continue;
+		batches.push_back({ renderer, numberOfTriangles });
+		numberOfTriangles += renderer->mesh->indices.size() / 3;
+		materialSettings.push_back(renderer->materialSetting != nullptr ? *renderer->materialSetting : MaterialSetting());
+	}
+	triangles.resize(numberOfTriangles);
+
+	// Transform all triangles to world space (same as voxelization.vert).
+	for (unsigned int b = 0; b < batches.size(); ++b) {
+		const Mesh & mesh = *batches[b].renderer->mesh;
+		const glm::mat4 M = batches[b].renderer->transform.getTransformMatrix();
+		const glm::mat3 N = glm::transpose(glm::inverse(glm::mat3(M)));
+		const unsigned int count = mesh.indices.size() / 3, first = batches[b].firstTriangle;
+		parallelFor(count, std::max(1u, std::min<unsigned int>(std::thread::hardware_concurrency(), count / 4096)),
+			[&](unsigned int, unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; ++i) {
+				Triangle & triangle = triangles[first + i];
+				for (unsigned int v = 0; v < 3; ++v) {
+					const VertexData & vertex = mesh.vertexData[mesh.indices[3 * i + v]];
+					triangle.positions[v] = glm::vec3(M * glm::vec4(vertex.position, 1));
+					triangle.normals[v] = glm::normalize(N * vertex.normal);
+				}
+				triangle.materialSetting = b;
+			}
+		});
+	}
+}
+
+void CPUVoxelizer::binTriangles(unsigned int threads)
+{
+	const int size = voxelTextureSize;
+	const unsigned int numberOfBins = std::max(1u, std::min(this->numberOfBins > 0 ? this->numberOfBins : 4 * threads, voxelTextureSize));
+	const auto binOf = [&](int z) { return ((z + 1) * numberOfBins - 1) / size; }; // Inverse of binStart.
+
+	// Each thread bins a contiguous range of triangles. The per-thread lists are then concatenated
+	// in thread order, which keeps every bin sorted by triangle index (i.e. in submission order).
+	std::vector<std::vector<std::vector<unsigned int>>> localBins(threads, std::vector<std::vector<unsigned int>>(numberOfBins));
+	parallelFor(triangles.size(), threads, [&](unsigned int t, unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; ++i) {
+			const Triangle & triangle = triangles[i];
+			const float minZ = std::min({ triangle.positions[0].z, triangle.positions[1].z, triangle.positions[2].z });
+			const float maxZ = std::max({ triangle.positions[0].z, triangle.positions[1].z, triangle.positions[2].z });
+			if (maxZ <= -1.0f || minZ >= 1.0f) continue;
+			const int firstVoxel = glm::clamp(int(size * (0.5f * minZ + 0.5f)), 0, size - 1);
+			const int lastVoxel = glm::clamp(int(size * (0.5f * maxZ + 0.5f)), 0, size - 1);
+			for (unsigned int bin = binOf(firstVoxel); bin <= binOf(lastVoxel); ++bin) localBins[t][bin].push_back(i);
+		}
+	});
+
+	bins.assign(numberOfBins, std::vector<unsigned int>());
+	parallelFor(numberOfBins, threads, [&](unsigned int, unsigned int begin, unsigned int end) {
+		for (unsigned int bin = begin; bin < end; ++bin) {
+			for (unsigned int t = 0; t < threads; ++t) bins[bin].insert(bins[bin].end(), localBins[t][bin].begin(), localBins[t][bin].end());
+		}
+	});
+}
+
+int CPUVoxelizer::binStart(unsigned int bin) const
+{
+	return (bin * voxelTextureSize) / bins.size();
+}
+
+void CPUVoxelizer::voxelizeBin(const Scene & scene, unsigned int bin)
+{
+	const int minZ = binStart(bin), maxZ = binStart(bin + 1) - 1;
+	for (const unsigned int i : bins[bin]) voxelizeTriangle(scene, triangles[i], bin, minZ, maxZ);
+}
+
+void CPUVoxelizer::voxelizeTriangle(const Scene & scene, const Triangle & triangle, unsigned int bin, int minZ, int maxZ)
+{
+	const int size = voxelTextureSize;
+	const glm::vec3 * p = triangle.positions;
+
+	// Project onto the dominant axis (same as voxelization.geom).
+	const glm::vec3 n = glm::abs(glm::cross(p[1] - p[0], p[2] - p[0]));
+	int u = 0, v = 2; // Pixel row v maps directly to voxel z when z is one of the projected axes.
+	if (n.z > n.x && n.z > n.y) { u = 0; v = 1; }
+	else if (n.x > n.y && n.x > n.z) { u = 1; v = 2; }
+	const glm::vec2 a[3] = { { p[0][u], p[0][v] }, { p[1][u], p[1][v] }, { p[2][u], p[2][v] } };
+
+	const float area = (a[1].x - a[0].x) * (a[2].y - a[0].y) - (a[1].y - a[0].y) * (a[2].x - a[0].x);
+	if (area == 0.0f) return;
+
+	// Rasterize at pixel centers of a voxelTextureSize x voxelTextureSize viewport covering [-1, 1]^2.
+	const auto toPixel = [size](float c) { return size * (0.5f * c + 0.5f) - 0.5f; };
+	int x0 = std::max(0, int(std::ceil(toPixel(std::min({ a[0].x, a[1].x, a[2].x })))));
+	int x1 = std::min(size - 1, int(std::floor(toPixel(std::max({ a[0].x, a[1].x, a[2].x })))));
+	int y0 = std::max(0, int(std::ceil(toPixel(std::min({ a[0].y, a[1].y, a[2].y })))));
+	int y1 = std::min(size - 1, int(std::floor(toPixel(std::max({ a[0].y, a[1].y, a[2].y })))));
+	if (v == 2) { y0 = std::max(y0, minZ); y1 = std::min(y1, maxZ); }
+
+	const MaterialSetting & materialSetting = materialSettings[triangle.materialSetting];
+	for (int y = y0; y <= y1; ++y) {
+		for (int x = x0; x <= x1; ++x) {
+			const glm::vec2 c((2 * x + 1) / float(size) - 1, (2 * y + 1) / float(size) - 1);
+			const float l0 = ((a[1].x - c.x) * (a[2].y - c.y) - (a[1].y - c.y) * (a[2].x - c.x)) / area;
+			const float l1 = ((a[2].x - c.x) * (a[0].y - c.y) - (a[2].y - c.y) * (a[0].x - c.x)) / area;
+			const float l2 = 1.0f - l0 - l1;
+			if (l0 < 0 || l1 < 0 || l2 < 0) continue;
+
+			const glm::vec3 position = l0 * p[0] + l1 * p[1] + l2 * p[2];
+			if (!isInsideCube(position)) continue;
+			const glm::ivec3 voxel = glm::ivec3(float(size) * (0.5f * position + glm::vec3(0.5f)));
+			if (voxel.z < minZ || voxel.z > maxZ) continue;
+
+			const glm::vec3 normal = l0 * triangle.normals[0] + l1 * triangle.normals[1] + l2 * triangle.normals[2];
+			const glm::vec4 result = shade(scene, materialSetting, position, normal);
+			if (fragmentList) {
+				const unsigned int color = toUnorm8(result.r) | toUnorm8(result.g) << 8 | toUnorm8(result.b) << 16 | toUnorm8(result.a) << 24;
+				binFragments[bin].push_back({ (unsigned int)(voxel.x | voxel.y << 10 | voxel.z << 20), color });
+				continue;
+			}
+			unsigned char * out = &voxels[4 * (voxel.x + size_t(size) * (voxel.y + size_t(size) * voxel.z))];
+			for (unsigned int i = 0; i < 4; ++i) out[i] = toUnorm8(result[i]);
+		}
+	}
+}
+
+glm::vec4 CPUVoxelizer::shade(const Scene & scene, const MaterialSetting & materialSetting, glm::vec3 position, glm::vec3 normal) const
+{
+	// Calculate diffuse lighting fragment contribution.
+	glm::vec3 color(0.0f);
+	const unsigned int maxLights = std::min<unsigned int>(scene.pointLights.size(), MAX_LIGHTS);
+	for (unsigned int i = 0; i < maxLights; ++i) {
+		const PointLight & light = scene.pointLights[i];
+		const glm::vec3 direction = glm::normalize(light.position - position);
+		const float d = std::max(glm::dot(glm::normalize(normal), direction), 0.0f);
+		color += d * POINT_LIGHT_INTENSITY * attenuate(glm::distance(light.position, position)) * light.color;
+	}
+	const glm::vec3 spec = materialSetting.specularReflectivity * materialSetting.specularColor;
+	const glm::vec3 diff = materialSetting.diffuseReflectivity * materialSetting.diffuseColor;
+	color = (diff + spec) * color + glm::clamp(materialSetting.emissivity, 0.0f, 1.0f) * materialSetting.diffuseColor;
+
+	const float alpha = std::pow(1 - materialSetting.transparency, 4.0f);
+	return alpha * glm::vec4(color, 1);
+}
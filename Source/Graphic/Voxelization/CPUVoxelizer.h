@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include <glm.hpp>
+
+#include "../Material/MaterialSetting.h"
+#include "SparseVoxelOctree.h"
+
+class Scene;
+
+/// <summary> A CPU reference implementation of the voxelization pass (see voxelization.geom and voxelization.frag).
+/// Does not require an OpenGL context, so it can be used for baking and as a correctness oracle for the GPU path. </summary>
+class CPUVoxelizer {
+public:
+	/// <summary> The resolution of the voxel grid. Must be set to a power of 2. </summary>
+	unsigned int voxelTextureSize = 64;
+
+	/// <summary> Number of worker threads. 0 means one thread per hardware thread. </summary>
+	unsigned int numberOfThreads = 0;
+
+	/// <summary> Number of spatial bins (z-slabs of the voxel grid) that triangles are sorted into.
+	/// 0 means that the number of bins is chosen automatically. </summary>
+	unsigned int numberOfBins = 0;
+
+	/// <summary> The voxelized scene. RGBA8, 4 bytes per voxel, indexed by x + size * (y + size * z).
+	/// Can be uploaded directly to a GL_RGBA8 3D texture using GL_RGBA and GL_UNSIGNED_BYTE. </summary>
+	std::vector<unsigned char> voxels;
+
+	/// <summary> Whether to write a voxel fragment list instead of the voxel grid, e.g. for SparseVoxelOctree::build.
+	/// The grid needs 4 bytes per voxel (4 GB at 1024^3), the list only 8 bytes per fragment. </summary>
+	bool fragmentList = false;
+
+	/// <summary> The voxelized scene as a fragment list, if fragmentList is set. Like in voxelization.frag, every triangle
+	/// that covers a voxel adds a fragment to it. </summary>
+	std::vector<SparseVoxelOctree::Fragment> fragments;
+
+	/// <summary> Voxelizes all enabled renderers in a scene. The result is independent of the number of threads. </summary>
+	void voxelize(Scene & scene);
+private:
+	struct Triangle {
+		glm::vec3 positions[3], normals[3];
+		unsigned int materialSetting;
+	};
+
+	std::vector<Triangle> triangles;
+	std::vector<MaterialSetting> materialSettings;
+	std::vector<std::vector<unsigned int>> bins;
+	std::vector<std::vector<SparseVoxelOctree::Fragment>> binFragments;
+
+	void gatherTriangles(Scene & scene);
+	void binTriangles(unsigned int threads);
+	int binStart(unsigned int bin) const;
+	void voxelizeBin(const Scene & scene, unsigned int bin);
+	void voxelizeTriangle(const Scene & scene, const Triangle & triangle, unsigned int bin, int minZ, int maxZ);
+	glm::vec4 shade(const Scene & scene, const MaterialSetting & materialSetting, glm::vec3 position, glm::vec3 normal) const;
+};
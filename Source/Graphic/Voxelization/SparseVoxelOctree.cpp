@@ -0,0 +1,145 @@
+#include "SparseVoxelOctree.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+namespace {
+	/// <summary> Spreads the 10 lowest bits of x so that there are two zero bits between each bit. </summary>
+	unsigned int spreadBits(unsigned int x) {
+		x &= 0x3ff;
+		x = (x | x << 16) & 0x30000ff;
+		x = (x | x << 8) & 0x300f00f;
+		x = (x | x << 4) & 0x30c30c3;
+		x = (x | x << 2) & 0x9249249;
+		return x;
+	}
+
+	/// <summary> Returns the Morton code of a packed fragment position. Bits 3 * l to 3 * l + 2 of the code is the
+	/// index of the node that contains the voxel on level l, so sorting by Morton code groups voxels by tile. </summary>
+	unsigned int mortonCode(unsigned int position) {
+		return spreadBits(position) | spreadBits(position >> 10) << 1 | spreadBits(position >> 20) << 2;
+	}
+
+	glm::vec4 unpackColor(unsigned int c) {
+		return glm::vec4(c & 0xff, (c >> 8) & 0xff, (c >> 16) & 0xff, c >> 24) / 255.0f;
+	}
+
+	unsigned int packColor(glm::vec4 c) {
+		c = glm::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f;
+		return (unsigned int)c.r | (unsigned int)c.g << 8 | (unsigned int)c.b << 16 | (unsigned int)c.a << 24;
+	}
+}
+
+void SparseVoxelOctree::build(const std::vector<Fragment> & fragments, unsigned int _resolution)
+{
+	assert(_resolution >= 2 && _resolution <= 1024 && (_resolution & (_resolution - 1)) == 0);
+	resolution = _resolution;
+	for (levels = 0; (1u << levels) < resolution; ++levels);
+
+	// Sort the fragments by Morton code. Duplicates become adjacent, and tiles are allocated in a cache friendly order.
+	std::vector<std::pair<unsigned int, unsigned int>> sorted(fragments.size());
+	for (unsigned int i = 0; i < fragments.size(); ++i) sorted[i] = { mortonCode(fragments[i].position), fragments[i].color };
+	std::sort(sorted.begin(), sorted.end());
+
+	nodes.assign(8, 0);
+	std::vector<glm::vec4> colors(8, glm::vec4(0.0f)); // Filtered in full precision and packed into the brick pool at the end.
+	for (unsigned int first = 0, last = 0; first < sorted.size(); first = last) {
+		// Average all fragments in this voxel.
+		const unsigned int code = sorted[first].first;
+		glm::vec4 color(0.0f);
+		for (last = first; last < sorted.size() && sorted[last].first == code; ++last) color += unpackColor(sorted[last].second);
+		color /= float(last - first);
+
+		// Insert the voxel, allocating tiles on the way down.
+		unsigned int tile = 0;
+		for (unsigned int level = levels - 1; level > 0; --level) {
+			const unsigned int node = 8 * tile + ((code >> (3 * level)) & 7);
+			if (nodes[node] == 0) {
+				nodes[node] = nodes.size() / 8;
+				nodes.resize(nodes.size() + 8, 0);
+				colors.resize(colors.size() + 8, glm::vec4(0.0f));
+			}
+			tile = nodes[node];
+		}
+		colors[8 * tile + (code & 7)] = color;
+	}
+
+	// Filter the bricks bottom-up. Children are always allocated after their parents, so a backward pass sees every child first.
+	for (unsigned int node = nodes.size(); node-- > 0;) {
+		if (nodes[node] == 0) continue;
+		glm::vec4 color(0.0f);
+		for (unsigned int i = 0; i < 8; ++i) color += colors[8 * nodes[node] + i];
+		colors[node] = color / 8.0f;
+	}
+
+	bricks.resize(colors.size());
+	for (unsigned int node = 0; node < colors.size(); ++node) bricks[node] = packColor(colors[node]);
+}
+
+void SparseVoxelOctree::build(const std::vector<unsigned char> & voxels, unsigned int _resolution)
+{
+	assert(voxels.size() == 4 * size_t(_resolution) * _resolution * _resolution);
+	std::vector<Fragment> fragments;
+	size_t i = 0;
+	for (unsigned int z = 0; z < _resolution; ++z) {
+		for (unsigned int y = 0; y < _resolution; ++y) {
+			for (unsigned int x = 0; x < _resolution; ++x, i += 4) {
+				const unsigned int color = voxels[i] | voxels[i + 1] << 8 | voxels[i + 2] << 16 | voxels[i + 3] << 24;
+				if (color != 0) fragments.push_back({ x | y << 10 | z << 20, color });
+			}
+		}
+	}
+	build(fragments, _resolution);
+}
+
+glm::vec4 SparseVoxelOctree::fetch(glm::ivec3 voxel, unsigned int level) const
+{
+	const int size = resolution >> level;
+	if (level > levels || glm::any(glm::lessThan(voxel, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(voxel, glm::ivec3(size))))
+		return glm::vec4(0.0f);
+
+	// The top level is the average of the root tile's brick.
+	if (level == levels) {
+		glm::vec4 color(0.0f);
+		for (unsigned int i = 0; i < 8; ++i) color += unpackColor(bricks[i]);
+		return color / 8.0f;
+	}
+
+	unsigned int tile = 0;
+	for (unsigned int l = levels - 1;; --l) {
+		const glm::ivec3 octant = (voxel >> int(l - level)) & 1;
+		const unsigned int node = 8 * tile + octant.x + 2 * octant.y + 4 * octant.z;
+		if (l == level) return unpackColor(bricks[node]);
+		tile = nodes[node];
+		if (tile == 0) return glm::vec4(0.0f);
+	}
+}
+
+glm::vec4 SparseVoxelOctree::sample(glm::vec3 position, float level) const
+{
+	level = glm::clamp(level, 0.0f, float(levels));
+	const unsigned int lower = (unsigned int)level;
+	const float t = level - lower;
+	const glm::vec4 color = sampleLevel(position, lower);
+	return t > 0.0f ? glm::mix(color, sampleLevel(position, lower + 1), t) : color;
+}
+
+glm::vec4 SparseVoxelOctree::sampleLevel(glm::vec3 position, unsigned int level) const
+{
+	const glm::vec3 p = position * float(resolution >> level) - 0.5f;
+	const glm::vec3 base = glm::floor(p), t = p - base;
+	glm::vec4 color(0.0f);
+	for (unsigned int i = 0; i < 8; ++i) {
+		const glm::ivec3 corner(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+		const glm::vec3 w = glm::mix(1.0f - t, t, glm::vec3(corner));
+		color += w.x * w.y * w.z * fetch(glm::ivec3(base) + corner, level);
+	}
+	return color;
+}
+
+size_t SparseVoxelOctree::getMemoryUsage() const
+{
+	return (nodes.size() + bricks.size()) * sizeof(unsigned int);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include <glm.hpp>
+
+/// <summary> A sparse voxel octree with a node pool and a brick pool (see Crassin et al., "GigaVoxels").
+/// Nodes are grouped into tiles of 8 siblings, and every tile has a 2x2x2 brick that stores the (premultiplied) RGBA8
+/// color of its 8 nodes. Interior nodes store the box filtered color of their subtree, i.e. the octree contains the same
+/// mipmap chain as a dense 3D texture would, but empty space costs nothing.
+/// The layout matches the traversal in voxel_cone_tracing.frag, so both pools can be uploaded to the GPU as they are. </summary>
+class SparseVoxelOctree {
+public:
+	/// <summary> A voxel fragment as written to the fragment list by voxelization.frag.
+	/// The position is packed as x | y << 10 | z << 20 and the color as RGBA8 (i.e. packUnorm4x8). </summary>
+	struct Fragment {
+		unsigned int position;
+		unsigned int color;
+	};
+
+	/// <summary> The node pool. Entry 8 * t + i is the tile that holds the children of node i in tile t, or 0 if the node
+	/// has no children. Tile 0 is the root tile. Node i covers the octant (i & 1, (i >> 1) & 1, (i >> 2) & 1) of its parent. </summary>
+	std::vector<unsigned int> nodes;
+
+	/// <summary> The brick pool. Entry 8 * t + i is the RGBA8 color of node i in tile t. </summary>
+	std::vector<unsigned int> bricks;
+
+	/// <summary> Builds the octree from a voxel fragment list. Fragments that end up in the same voxel are averaged.
+	/// The resolution must be a power of 2 between 2 and 1024. </summary>
+	void build(const std::vector<Fragment> & fragments, unsigned int resolution);
+
+	/// <summary> Builds the octree from a dense RGBA8 voxel grid indexed by x + size * (y + size * z) (e.g. CPUVoxelizer::voxels). </summary>
+	void build(const std::vector<unsigned char> & voxels, unsigned int resolution);
+
+	/// <summary> Returns the voxel at an integer position on a given level (0 is the finest level). Empty space is (0, 0, 0, 0). </summary>
+	glm::vec4 fetch(glm::ivec3 voxel, unsigned int level) const;
+
+	/// <summary> Samples the octree at a position in [0, 1]^3 using quadrilinear filtering, i.e. in the same way
+	/// as textureLod samples a mipmapped 3D texture with a transparent border. </summary>
+	glm::vec4 sample(glm::vec3 position, float level) const;
+
+	/// <summary> The effective resolution of the finest level. </summary>
+	unsigned int getResolution() const { return resolution; }
+
+	/// <summary> The number of levels below the top, i.e. log2 of the resolution. Level 0 has the full resolution,
+	/// level getLevels() - 1 is the root tile's brick and level getLevels() is a single voxel. </summary>
+	unsigned int getLevels() const { return levels; }
+
+	/// <summary> The size of the node pool and the brick pool in bytes. </summary>
+	size_t getMemoryUsage() const;
+private:
+	unsigned int resolution = 0, levels = 0;
+	glm::vec4 sampleLevel(glm::vec3 position, unsigned int level) const;
+};
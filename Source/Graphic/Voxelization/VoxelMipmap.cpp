@@ -0,0 +1,86 @@
+#include "VoxelMipmap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace {
+	const int BLOCK_SIZE = 1 << VoxelMipmap::LEVELS_PER_PASS; // Source voxels per block (i.e. per work group) along every axis.
+
+	glm::vec4 unpackColor(const unsigned char * c) {
+		return glm::vec4(c[0], c[1], c[2], c[3]) / 255.0f;
+	}
+
+	void packColor(glm::vec4 color, unsigned char * c) {
+		color = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+		for (unsigned int i = 0; i < 4; ++i) c[i] = (unsigned char)color[i];
+	}
+}
+
+void VoxelMipmap::build(const std::vector<unsigned char> & voxels, unsigned int _resolution)
+{
+	assert(_resolution >= 1 && (_resolution & (_resolution - 1)) == 0);
+	assert(voxels.size() == 4 * _resolution * _resolution * _resolution);
+	resolution = _resolution;
+
+	levels.assign(1, voxels);
+	for (unsigned int size = resolution / 2; size > 0; size /= 2) levels.push_back(std::vector<unsigned char>(4 * size * size * size));
+	update(glm::ivec3(0), glm::ivec3(resolution));
+}
+
+void VoxelMipmap::update(glm::ivec3 regionMin, glm::ivec3 regionMax)
+{
+	regionMin = glm::clamp(regionMin, 0, int(resolution));
+	regionMax = glm::clamp(regionMax, 0, int(resolution));
+	if (glm::any(glm::greaterThanEqual(regionMin, regionMax))) return;
+
+	for (unsigned int sourceLevel = 0; sourceLevel + 1 < levels.size(); sourceLevel += LEVELS_PER_PASS) {
+		const unsigned int numberOfLevels = std::min<unsigned int>(LEVELS_PER_PASS, levels.size() - 1 - sourceLevel);
+		const glm::ivec3 first = (regionMin >> int(sourceLevel)) / BLOCK_SIZE;
+		const glm::ivec3 last = ((regionMax - 1) >> int(sourceLevel)) / BLOCK_SIZE;
+		for (int z = first.z; z <= last.z; ++z) {
+			for (int y = first.y; y <= last.y; ++y) {
+				for (int x = first.x; x <= last.x; ++x) buildBlock(sourceLevel, numberOfLevels, glm::ivec3(x, y, z));
+			}
+		}
+	}
+}
+
+void VoxelMipmap::buildBlock(unsigned int sourceLevel, unsigned int numberOfLevels, glm::ivec3 block)
+{
+	// Load the block. Voxels outside of the source level are empty.
+	const int sourceSize = resolution >> sourceLevel;
+	glm::vec4 voxels[BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE];
+	for (int z = 0; z < BLOCK_SIZE; ++z) {
+		for (int y = 0; y < BLOCK_SIZE; ++y) {
+			for (int x = 0; x < BLOCK_SIZE; ++x) {
+				const glm::ivec3 p = BLOCK_SIZE * block + glm::ivec3(x, y, z);
+				const bool inside = glm::all(glm::lessThan(p, glm::ivec3(sourceSize)));
+				voxels[x + BLOCK_SIZE * (y + BLOCK_SIZE * z)] = inside ?
+					unpackColor(&levels[sourceLevel][4 * (p.x + sourceSize * (p.y + sourceSize * p.z))]) : glm::vec4(0.0f);
+			}
+		}
+	}
+
+	// Reduce it in place, one level at a time.
+	for (unsigned int level = 1; level <= numberOfLevels; ++level) {
+		const int step = 1 << (level - 1);
+		const int size = std::max(sourceSize >> level, 1);
+		for (int z = 0; z < BLOCK_SIZE; z += 2 * step) {
+			for (int y = 0; y < BLOCK_SIZE; y += 2 * step) {
+				for (int x = 0; x < BLOCK_SIZE; x += 2 * step) {
+					glm::vec4 color(0.0f);
+					for (int i = 0; i < 8; ++i) {
+						const glm::ivec3 child = glm::ivec3(x, y, z) + step * glm::ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+						color += voxels[child.x + BLOCK_SIZE * (child.y + BLOCK_SIZE * child.z)];
+					}
+					color /= 8.0f;
+					voxels[x + BLOCK_SIZE * (y + BLOCK_SIZE * z)] = color;
+
+					const glm::ivec3 p = ((BLOCK_SIZE * block) >> int(level)) + glm::ivec3(x, y, z) / (2 * step);
+					if (glm::all(glm::lessThan(p, glm::ivec3(size)))) packColor(color, &levels[sourceLevel + level][4 * (p.x + size * (p.y + size * p.z))]);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include <glm.hpp>
+
+/// <summary> A CPU implementation of the voxel mipmap filter in mipmap.comp. Does not require an OpenGL context.
+/// Colors are premultiplied by alpha, so averaging the 8 children is the alpha weighted average of their colors,
+/// i.e. empty voxels lower the opacity of a coarser voxel, but they don't darken its color.
+/// Like the compute shader, levels are built 3 at a time from an RGBA8 level, and intermediate levels are kept in
+/// full precision, so the mipmap is only quantized once per level (instead of accumulating rounding errors). </summary>
+class VoxelMipmap {
+public:
+	/// <summary> Number of levels that are built from the same RGBA8 level (i.e. per compute shader dispatch). </summary>
+	static const unsigned int LEVELS_PER_PASS = 3;
+
+	/// <summary> All levels, RGBA8, 4 bytes per voxel, indexed by x + size * (y + size * z) where size = resolution >> level.
+	/// Level 0 is the voxel grid and the last level is a single voxel. </summary>
+	std::vector<std::vector<unsigned char>> levels;
+
+	/// <summary> Builds all levels from a voxel grid (e.g. CPUVoxelizer::voxels). The resolution must be a power of 2. </summary>
+	void build(const std::vector<unsigned char> & voxels, unsigned int resolution);
+
+	/// <summary> Rebuilds the voxels of levels >= 1 that cover the voxels [regionMin, regionMax) of level 0.
+	/// Is used after a part of level 0 has been changed. </summary>
+	void update(glm::ivec3 regionMin, glm::ivec3 regionMax);
+
+	/// <summary> The resolution of level 0. </summary>
+	unsigned int getResolution() const { return resolution; }
+private:
+	unsigned int resolution = 0;
+	void buildBlock(unsigned int sourceLevel, unsigned int numberOfLevels, glm::ivec3 block);
+};
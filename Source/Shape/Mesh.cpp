@@ -4,6 +4,10 @@
 #include <glew.h>
 #include <glfw3.h>
 #include <gtc/type_ptr.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <algorithm>
 
 Mesh::Mesh() { }
 
@@ -20,4 +24,49 @@ Mesh::~Mesh() {
 		// Reset.
 		glUseProgram(curp);
 	}
-}
\ No newline at end of file
+}
+
+void Mesh::getBounds(glm::vec3 & min, glm::vec3 & max) const
+{
+	min = max = vertexData.empty() ? glm::vec3(0.0f) : vertexData[0].position;
+	for (const auto & vertex : vertexData) {
+		min = glm::min(min, vertex.position);
+		max = glm::max(max, vertex.position);
+	}
+}
+
+glm::mat4 Mesh::packVertexData(std::vector<PackedVertexData> & packed) const
+{
+	// Flat meshes have no extent along some axis, but the dequantization matrix has to be invertible.
+	glm::vec3 min, max;
+	getBounds(min, max);
+	glm::vec3 extent = max - min;
+	for (int i = 0; i < 3; ++i) if (extent[i] <= 0.0f) extent[i] = 1.0f;
+
+	// Snorm conversion is c / 511 (clamped to -1), i.e. the normal is rounded to a multiple of 1 / 511.
+	auto packNormal = [](glm::vec3 n) {
+		n = glm::length(n) > 0.0f ? glm::normalize(n) : n;
+		uint32_t result = 0;
+		for (int i = 0; i < 3; ++i) {
+			const int32_t c = (int32_t)std::round(glm::clamp(n[i], -1.0f, 1.0f) * 511.0f);
+			result |= ((uint32_t)c & 0x3ff) << (10 * i);
+		}
+		return result;
+	};
+
+	packed.reserve(packed.size() + vertexData.size());
+	for (const auto & vertex : vertexData) {
+		const glm::vec3 p = glm::clamp((vertex.position - min) / extent, 0.0f, 1.0f) * 65535.0f;
+		PackedVertexData v = { { (uint16_t)std::round(p.x), (uint16_t)std::round(p.y), (uint16_t)std::round(p.z), 0 }, 0 };
+		v.normal = packNormal(vertex.normal * extent);
+		packed.push_back(v);
+	}
+	return glm::scale(glm::translate(glm::mat4(1.0f), min), extent);
+}
+
+unsigned int Mesh::getLevelOfDetail(float maxError) const
+{
+	unsigned int level = 0;
+	while (level < levelsOfDetail.size() && levelsOfDetail[level].error <= maxError) ++level;
+	return level;
+}
@@ -17,6 +17,39 @@ public:
 	std::vector<VertexData> vertexData;
 	std::vector<unsigned int> indices;
 
+	/// <summary> A simplified version of the mesh, which uses the same vertices (see MeshSimplifier). </summary>
+	struct LevelOfDetail {
+		std::vector<unsigned int> indices;
+		float error; // The estimated (root mean square) distance between the level and the mesh, in model space.
+	};
+
+	/// <summary> The levels of detail of the mesh, from the finest to the coarsest. Level 0 is the mesh itself, so level i is
+	/// levelsOfDetail[i - 1]. They are only used by the voxelization (see Graphics::voxelizationLevelOfDetail). </summary>
+	std::vector<LevelOfDetail> levelsOfDetail;
+
+	/// <summary> Returns the indices of a level of detail. </summary>
+	const std::vector<unsigned int> & getIndices(unsigned int level) const { return level == 0 ? indices : levelsOfDetail[level - 1].indices; }
+
+	/// <summary> Returns the coarsest level of detail whose error is at most the given error (in model space). </summary>
+	unsigned int getLevelOfDetail(float maxError) const;
+
+	/// <summary> If true, the vertices are uploaded in a compact format that only contains positions and normals (see PackedVertexData).
+	/// Is set for the meshes of the scene by Graphics::packedVertexData. Must be false if the mesh is drawn by a shader that reads
+	/// the positions without a model matrix (e.g. a screen quad). </summary>
+	bool packedVertexData = false;
+
+	/// <summary> Transforms the uploaded positions to model space, i.e. it's a part of the model matrix (see MeshRenderer::render).
+	/// Is the identity if the vertices aren't packed. </summary>
+	glm::mat4 dequantizationMatrix = glm::mat4(1.0f);
+
+	/// <summary> Returns the bounding box of the mesh in model space. </summary>
+	void getBounds(glm::vec3 & min, glm::vec3 & max) const;
+
+	/// <summary> Appends the vertices in the packed format, and returns the dequantization matrix of the packed positions.
+	/// Positions are quantized to 16 bits relative to the bounds of the mesh. The normals are scaled by the inverse of the
+	/// dequantization, so that they are restored by the normal matrix (i.e. the inverse transpose) of the model matrix. </summary>
+	glm::mat4 packVertexData(std::vector<PackedVertexData> & packed) const;
+
 	// Used for (shared) rendering.
 	int program;
 	unsigned int vbo, vao, ebo; // Vertex Buffer Object, Vertex Array Object, Element Buffer Object.
@@ -8,11 +8,26 @@ Transform::Transform() {
 
 void Transform::updateTransformMatrix() {
 	transform = glm::translate(position) * glm::mat4_cast(glm::quat(rotation)) * glm::scale(scale);
+	if (parent != nullptr) { transform = parent->getTransformMatrix() * transform; }
+	matrixPosition = position;
+	matrixScale = scale;
+	matrixRotation = rotation;
+	matrixParent = parent;
+	matrixParentVersion = parent != nullptr ? parent->version : 0;
+	++version;
 	transformIsInvalid = false;
 }
 
-glm::mat4 & Transform::getTransformMatrix() {
-	if (transformIsInvalid) { updateTransformMatrix(); }
+bool Transform::isTransformMatrixOutdated() {
+	if (transformIsInvalid || position != matrixPosition || scale != matrixScale || rotation != matrixRotation) { return true; }
+	if (parent != matrixParent) { return true; }
+	if (parent == nullptr) { return false; }
+	parent->getTransformMatrix(); // Brings the parent (and its parents) up to date, which changes its version if it has moved.
+	return parent->version != matrixParentVersion;
+}
+
+const glm::mat4 & Transform::getTransformMatrix() {
+	if (isTransformMatrixOutdated()) { updateTransformMatrix(); }
 	return transform;
 }
 
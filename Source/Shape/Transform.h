@@ -12,18 +12,22 @@
 class Transform {
 public:
 	glm::vec3 position = { 0,0,0 }, scale = { 1,1,1 }, rotation = { 0,0,0 };
+
+	/// <summary> The transform that this transform is relative to, if any. The transform matrix includes the parents. </summary>
 	Transform * parent = nullptr;
 
 	Transform();
 
-	/// <summary> Is true when the transform matrix is not correctly representing the position, scale and rotation vectors. </summary>
+	/// <summary> Forces the transform matrix to be recalculated the next time it's used.
+	/// Changing the position, scale, rotation or parent invalidates the matrix automatically. </summary>
 	bool transformIsInvalid = false;
 
-	/// <summary> Recalculates the transform matrix according to the position, scale and rotation vectors. </summary>
+	/// <summary> Recalculates the transform matrix according to the position, scale and rotation vectors (and the parent). </summary>
 	void updateTransformMatrix();
 
-	/// <summary> Returns a reference to the transform matrix </summary>
-	glm::mat4 & getTransformMatrix();
+	/// <summary> Returns a reference to the transform matrix. It's only recalculated if the transform or a parent has changed
+	/// since it was last calculated, so calling this every frame is cheap for transforms that don't move. </summary>
+	const glm::mat4 & getTransformMatrix();
 
 	/// <summary> Output. </summary>
 	friend std::ostream & operator<<(std::ostream &, const Transform &);
@@ -34,4 +38,11 @@ public:
 	glm::vec3 right();
 private:
 	glm::mat4 transform;
+
+	// What the transform matrix was calculated from. Compared instead of using setters, since the vectors are written directly.
+	glm::vec3 matrixPosition, matrixScale, matrixRotation;
+	const Transform * matrixParent = nullptr;
+	unsigned int matrixParentVersion = 0;
+	unsigned int version = 0; // Incremented whenever the transform matrix is recalculated, so that children notice.
+	bool isTransformMatrixOutdated();
 };
\ No newline at end of file
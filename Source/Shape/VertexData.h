@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include <glm.hpp>
 
 /// <summary> Contains information about vertices such as position, normal, texture coordinate and color. </summary>
@@ -11,4 +13,11 @@ public:
 		glm::vec3 _position = glm::vec3(0, 0, 0), glm::vec3 _color = glm::vec3(1, 1, 1),
 		glm::vec3 _normal = glm::vec3(0, 0, 0), glm::vec2 _texCoord = glm::vec2(0, 0)) :
 		position(_position), normal(_normal), color(_color), texCoord(_texCoord) {}
-};
\ No newline at end of file
+};
+
+/// <summary> The compact vertex format that meshes are uploaded in (see Mesh::packedVertexData). Only contains the attributes
+/// that are read by the shaders, i.e. 12 instead of 44 bytes per vertex. </summary>
+struct PackedVertexData {
+	uint16_t position[4]; // Normalized relative to the bounds of the mesh (see Mesh::dequantizationMatrix). The fourth is padding.
+	uint32_t normal; // Signed and normalized 10:10:10:2 (i.e. GL_INT_2_10_10_10_REV).
+};
@@ -0,0 +1,40 @@
+#include "Directory.h"
+
+#include <cerrno>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/types.h>
+#endif
+
+namespace {
+	bool exists(const std::string & path) {
+		struct stat status;
+		return stat(path.c_str(), &status) == 0 && (status.st_mode & S_IFDIR) != 0;
+	}
+
+	bool makeDirectory(const std::string & path) {
+#ifdef _WIN32
+		return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+		return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+	}
+}
+
+bool Directory::create(const std::string & path)
+{
+	// Trailing separators are dropped, since stat doesn't accept them on Windows.
+	std::string folder = path;
+	while (folder.size() > 1 && (folder.back() == '/' || folder.back() == '\\')) folder.pop_back();
+	if (folder.empty() || exists(folder)) return true;
+
+	// Create the parents first, i.e. every prefix that ends before a separator.
+	for (size_t end = folder.find_first_of("/\\", 1); end != std::string::npos; end = folder.find_first_of("/\\", end + 1)) {
+		const std::string parent = folder.substr(0, end);
+		if (!exists(parent) && !makeDirectory(parent)) return false;
+	}
+	return makeDirectory(folder) && exists(folder);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+namespace Directory {
+	/// <summary> Creates a folder and any missing parent folders. Paths use '/' (which Windows also accepts).
+	/// Returns true if the folder exists afterwards. </summary>
+	bool create(const std::string & path);
+}
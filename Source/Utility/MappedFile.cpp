@@ -0,0 +1,53 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string & path)
+{
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) { file = nullptr; return; }
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+	fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (fileMapping == nullptr) return;
+	mapping = (const unsigned char *)MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+	if (mapping != nullptr) mappingSize = (size_t)fileSize.QuadPart;
+}
+
+MappedFile::~MappedFile()
+{
+	if (mapping != nullptr) UnmapViewOfFile(mapping);
+	if (fileMapping != nullptr) CloseHandle(fileMapping);
+	if (file != nullptr) CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const std::string & path)
+{
+	const int file = open(path.c_str(), O_RDONLY);
+	if (file < 0) return;
+	struct stat fileStatus;
+	if (fstat(file, &fileStatus) == 0 && fileStatus.st_size > 0) {
+		void * view = mmap(nullptr, (size_t)fileStatus.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (view != MAP_FAILED) {
+			mapping = (const unsigned char *)view;
+			mappingSize = (size_t)fileStatus.st_size;
+		}
+	}
+	close(file); // The mapping stays valid.
+}
+
+MappedFile::~MappedFile()
+{
+	if (mapping != nullptr) munmap((void *)mapping, mappingSize);
+}
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+/// <summary> A read-only memory mapping of a whole file. Nothing is mapped if the file can't be opened (or is empty). </summary>
+class MappedFile {
+public:
+	MappedFile(const std::string & path);
+	~MappedFile();
+
+	bool isMapped() const { return mapping != nullptr; }
+	const unsigned char * data() const { return mapping; }
+	size_t size() const { return mappingSize; }
+private:
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	const unsigned char * mapping = nullptr;
+	size_t mappingSize = 0;
+#ifdef _WIN32
+	void * file = nullptr, * fileMapping = nullptr; // Handles.
+#endif
+};
@@ -0,0 +1,138 @@
+#include "MeshOptimizer.h"
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+	/// <summary> Hashes and compares the bytes of the vertex data, i.e. welded vertices are identical in every attribute. </summary>
+	struct VertexDataHash {
+		size_t operator()(const VertexData & vertex) const {
+			uint64_t h = 14695981039346656037ull;
+			const unsigned char * bytes = (const unsigned char *)&vertex;
+			for (size_t i = 0; i < sizeof(VertexData); ++i) { h = (h ^ bytes[i]) * 1099511628211ull; }
+			return (size_t)h;
+		}
+	};
+	struct VertexDataEqual {
+		bool operator()(const VertexData & a, const VertexData & b) const { return std::memcmp(&a, &b, sizeof(VertexData)) == 0; }
+	};
+}
+
+unsigned int MeshOptimizer::weldVertices(Mesh & mesh)
+{
+	std::unordered_map<VertexData, unsigned int, VertexDataHash, VertexDataEqual> welded(mesh.vertexData.size());
+	std::vector<unsigned int> remap(mesh.vertexData.size());
+	std::vector<VertexData> vertexData;
+	vertexData.reserve(mesh.vertexData.size());
+	for (unsigned int i = 0; i < mesh.vertexData.size(); ++i) {
+		const auto vertex = welded.emplace(mesh.vertexData[i], (unsigned int)vertexData.size());
+		if (vertex.second) vertexData.push_back(mesh.vertexData[i]);
+		remap[i] = vertex.first->second;
+	}
+	for (auto & index : mesh.indices) index = remap[index];
+	const unsigned int removed = mesh.vertexData.size() - vertexData.size();
+	mesh.vertexData.swap(vertexData);
+	return removed;
+}
+
+void MeshOptimizer::optimizeVertexCache(Mesh & mesh, unsigned int cacheSize)
+{
+	const unsigned int numberOfVertices = mesh.vertexData.size();
+	const unsigned int numberOfTriangles = mesh.indices.size() / 3;
+	if (numberOfTriangles == 0) return;
+	const auto & indices = mesh.indices;
+
+	// The triangles of every vertex (in compressed rows), and the number of them that haven't been emitted yet.
+	std::vector<unsigned int> live(numberOfVertices, 0), offsets(numberOfVertices + 1, 0), adjacency(3 * numberOfTriangles);
+	for (unsigned int i = 0; i < 3 * numberOfTriangles; ++i) ++live[indices[i]];
+	for (unsigned int v = 0; v < numberOfVertices; ++v) offsets[v + 1] = offsets[v] + live[v];
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (unsigned int i = 0; i < 3 * numberOfTriangles; ++i) adjacency[fill[indices[i]]++] = i / 3;
+
+	std::vector<unsigned int> cacheTime(numberOfVertices, 0), deadEnd, candidates, result;
+	std::vector<bool> emitted(numberOfTriangles, false);
+	result.reserve(3 * numberOfTriangles);
+	unsigned int time = cacheSize + 1, cursor = 0;
+	int fanning = indices[0];
+
+	while (fanning >= 0) {
+		// Emit the remaining triangles around the fanning vertex.
+		candidates.clear();
+		for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+			const unsigned int triangle = adjacency[a];
+			if (emitted[triangle]) continue;
+			emitted[triangle] = true;
+			for (unsigned int k = 0; k < 3; ++k) {
+				const unsigned int v = indices[3 * triangle + k];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if (time - cacheTime[v] > cacheSize) cacheTime[v] = time++;
+			}
+		}
+
+		// Continue with the candidate that stays in the cache the longest after its triangles have been emitted.
+		fanning = -1;
+		int bestPriority = -1;
+		for (unsigned int v : candidates) {
+			if (live[v] == 0) continue;
+			const int priority = time - cacheTime[v] + 2 * live[v] <= cacheSize ? time - cacheTime[v] : 0;
+			if (priority > bestPriority) { bestPriority = priority; fanning = v; }
+		}
+
+		// Dead end: use a recently used vertex that has triangles left, or the next one in input order.
+		while (fanning < 0 && !deadEnd.empty()) {
+			const unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0) fanning = v;
+		}
+		for (; fanning < 0 && cursor < numberOfVertices; ++cursor) {
+			if (live[cursor] > 0) fanning = cursor;
+		}
+	}
+	mesh.indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(Mesh & mesh)
+{
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(mesh.vertexData.size(), unused);
+	std::vector<VertexData> vertexData;
+	vertexData.reserve(mesh.vertexData.size());
+	for (auto & index : mesh.indices) {
+		if (remap[index] == unused) {
+			remap[index] = vertexData.size();
+			vertexData.push_back(mesh.vertexData[index]);
+		}
+		index = remap[index];
+	}
+	for (unsigned int i = 0; i < mesh.vertexData.size(); ++i) {
+		if (remap[i] == unused) vertexData.push_back(mesh.vertexData[i]);
+	}
+	mesh.vertexData.swap(vertexData);
+}
+
+void MeshOptimizer::optimize(Mesh & mesh)
+{
+	weldVertices(mesh);
+	optimizeVertexCache(mesh);
+	optimizeVertexFetch(mesh);
+}
+
+float MeshOptimizer::getAverageCacheMissRatio(const Mesh & mesh, unsigned int cacheSize)
+{
+	if (mesh.indices.size() < 3) return 0.0f;
+	std::vector<unsigned int> cacheTime(mesh.vertexData.size(), 0);
+	unsigned int time = cacheSize + 1, misses = 0;
+	for (auto index : mesh.indices) {
+		if (time - cacheTime[index] > cacheSize) {
+			cacheTime[index] = time++;
+			++misses;
+		}
+	}
+	return misses / float(mesh.indices.size() / 3);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "../Shape/Mesh.h"
+
+/// <summary> Optimizes imported meshes for rendering (see ObjLoader). Every vertex is transformed by both the voxelization
+/// and the shading passes, so fewer vertices and better post-transform cache reuse make every frame cheaper. </summary>
+namespace MeshOptimizer {
+	/// <summary> The post-transform cache size that triangles are ordered for. </summary>
+	const unsigned int CACHE_SIZE = 16;
+
+	/// <summary> Merges vertices whose data is identical, and remaps the indices. Returns the number of vertices removed. </summary>
+	unsigned int weldVertices(Mesh & mesh);
+
+	/// <summary> Reorders the triangles for the post-transform vertex cache, using Tipsify
+	/// (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007). </summary>
+	void optimizeVertexCache(Mesh & mesh, unsigned int cacheSize = CACHE_SIZE);
+
+	/// <summary> Reorders the vertices in the order that the triangles first use them, so that vertex fetches are
+	/// (mostly) sequential. Unused vertices are moved to the end. </summary>
+	void optimizeVertexFetch(Mesh & mesh);
+
+	/// <summary> Welds the vertices of a mesh, then optimizes it for the vertex cache and for vertex fetches. </summary>
+	void optimize(Mesh & mesh);
+
+	/// <summary> Returns the average number of vertices transformed per triangle (ACMR) with a FIFO cache of the given size. </summary>
+	float getAverageCacheMissRatio(const Mesh & mesh, unsigned int cacheSize = CACHE_SIZE);
+}
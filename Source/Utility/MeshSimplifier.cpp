@@ -0,0 +1,233 @@
+#include "MeshSimplifier.h"
+
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace {
+	/// <summary> The weighted sum of the squared distances to a set of planes, i.e. Q(p) = p^T A p + 2 b.p + c with a symmetric A. </summary>
+	struct Quadric {
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0, b0 = 0, b1 = 0, b2 = 0, c = 0, weight = 0;
+
+		Quadric() {}
+
+		/// <summary> The plane n.p + d = 0, where n is a unit normal. </summary>
+		Quadric(const glm::dvec3 & n, double d, double w) :
+			a00(w * n.x * n.x), a01(w * n.x * n.y), a02(w * n.x * n.z), a11(w * n.y * n.y), a12(w * n.y * n.z), a22(w * n.z * n.z),
+			b0(w * d * n.x), b1(w * d * n.y), b2(w * d * n.z), c(w * d * d), weight(w) {}
+
+		Quadric & operator+=(const Quadric & q) {
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c; weight += q.weight;
+			return *this;
+		}
+
+		/// <summary> Returns the weighted mean of the squared distances, i.e. the squared error of moving a vertex to p. </summary>
+		double evaluate(const glm::dvec3 & p) const {
+			const double q = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+				+ 2 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+				+ 2 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+			return weight > 0 ? std::max(q, 0.0) / weight : 0.0;
+		}
+	};
+
+	/// <summary> Moves a vertex onto a neighbour. Is outdated if either vertex has changed since it was queued. </summary>
+	struct Collapse {
+		double error;
+		unsigned int from, to, fromVersion, toVersion;
+		bool operator<(const Collapse & other) const { return error > other.error; } // The queue pops the smallest error.
+	};
+
+	/// <summary> Borders are kept in place by planes through them, perpendicular to their triangles. The weight is relative to
+	/// that of the triangles (i.e. their area), so that a border edge counts as much as a triangle that is 20 times its area. </summary>
+	const double BORDER_WEIGHT = 10.0;
+
+	const unsigned int NONE = std::numeric_limits<unsigned int>::max();
+
+	struct PositionHash {
+		size_t operator()(const glm::vec3 & p) const {
+			uint64_t h = 14695981039346656037ull;
+			const unsigned char * bytes = (const unsigned char *)&p;
+			for (size_t i = 0; i < sizeof(glm::vec3); ++i) { h = (h ^ bytes[i]) * 1099511628211ull; }
+			return (size_t)h;
+		}
+	};
+	struct PositionEqual {
+		bool operator()(const glm::vec3 & a, const glm::vec3 & b) const { return std::memcmp(&a, &b, sizeof(glm::vec3)) == 0; }
+	};
+}
+
+void MeshSimplifier::generateLevelsOfDetail(Mesh & mesh)
+{
+	mesh.levelsOfDetail.clear();
+	const unsigned int numberOfVertices = mesh.vertexData.size();
+	const unsigned int numberOfTriangles = mesh.indices.size() / 3;
+	if (numberOfTriangles / 2 < MIN_TRIANGLES) return;
+	auto position = [&](unsigned int v) { return mesh.vertexData[v].position; };
+
+	// Vertices with the same position are simplified as one, i.e. as the first of them (their representative). The levels
+	// use the vertex of every corner though, so that normals and texture coordinates stay on their side of seams.
+	std::vector<unsigned int> triangles(3 * numberOfTriangles), corners(mesh.indices);
+	std::vector<unsigned int> nextAtPosition(numberOfVertices, NONE); // Links the vertices of a representative.
+	{
+		std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> representatives(numberOfVertices);
+		std::vector<unsigned int> representative(numberOfVertices);
+		for (unsigned int v = 0; v < numberOfVertices; ++v) {
+			const unsigned int r = representative[v] = representatives.emplace(position(v), v).first->second;
+			if (r != v) {
+				nextAtPosition[v] = nextAtPosition[r];
+				nextAtPosition[r] = v;
+			}
+		}
+		for (unsigned int i = 0; i < triangles.size(); ++i) triangles[i] = representative[mesh.indices[i]];
+	}
+
+	// A corner that is moved onto another representative uses the vertex there whose attributes are closest to its own.
+	auto closestVertex = [&](unsigned int r, unsigned int v) {
+		const VertexData & vertex = mesh.vertexData[v];
+		unsigned int closest = r;
+		float closestDistance = std::numeric_limits<float>::max();
+		for (unsigned int w = r; w != NONE; w = nextAtPosition[w]) {
+			const float distance = glm::length(mesh.vertexData[w].normal - vertex.normal) + glm::length(mesh.vertexData[w].texCoord - vertex.texCoord);
+			if (distance < closestDistance) {
+				closest = w;
+				closestDistance = distance;
+			}
+		}
+		return closest;
+	};
+
+	// Every vertex starts with the planes of its triangles, and the borders are found by counting the triangles of every edge.
+	std::vector<Quadric> quadrics(numberOfVertices);
+	std::vector<bool> removed(numberOfTriangles, false);
+	std::unordered_map<uint64_t, unsigned int> edges(3 * numberOfTriangles); // The first corner of an edge + 1, or 0 if shared.
+	unsigned int remaining = numberOfTriangles;
+	for (unsigned int t = 0; t < numberOfTriangles; ++t) {
+		const unsigned int * v = &triangles[3 * t];
+		if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0]) {
+			removed[t] = true;
+			--remaining;
+			continue;
+		}
+		const glm::dvec3 a(position(v[0])), b(position(v[1])), c(position(v[2]));
+		const glm::dvec3 normal = glm::cross(b - a, c - a);
+		const double length = glm::length(normal);
+		if (length > 0) {
+			const Quadric plane(normal / length, -glm::dot(normal / length, a), 0.5 * length);
+			for (unsigned int k = 0; k < 3; ++k) quadrics[v[k]] += plane;
+		}
+		for (unsigned int k = 0; k < 3; ++k) {
+			const unsigned int x = v[k], y = v[(k + 1) % 3];
+			const uint64_t key = ((uint64_t)std::min(x, y) << 32) | std::max(x, y);
+			auto edge = edges.emplace(key, 3 * t + k + 1);
+			if (!edge.second) edge.first->second = 0;
+		}
+	}
+	for (const auto & edge : edges) if (edge.second > 0) {
+		const unsigned int corner = edge.second - 1, t = corner / 3;
+		const glm::dvec3 a(position(triangles[3 * t])), b(position(triangles[3 * t + 1])), c(position(triangles[3 * t + 2]));
+		const glm::dvec3 x(position(triangles[corner])), y(position(triangles[3 * t + (corner + 1) % 3]));
+		const glm::dvec3 perpendicular = glm::cross(y - x, glm::cross(b - a, c - a));
+		const double length = glm::length(perpendicular);
+		if (length == 0) continue;
+		const Quadric plane(perpendicular / length, -glm::dot(perpendicular / length, x), BORDER_WEIGHT * glm::dot(y - x, y - x));
+		quadrics[triangles[corner]] += plane;
+		quadrics[triangles[3 * t + (corner + 1) % 3]] += plane;
+	}
+	edges.clear();
+
+	// The triangles of every vertex. Lists may contain triangles that have been removed or moved to another vertex.
+	std::vector<std::vector<unsigned int>> vertexTriangles(numberOfVertices);
+	for (unsigned int t = 0; t < numberOfTriangles; ++t) if (!removed[t]) {
+		for (unsigned int k = 0; k < 3; ++k) vertexTriangles[triangles[3 * t + k]].push_back(t);
+	}
+	auto contains = [&](unsigned int t, unsigned int v) {
+		return triangles[3 * t] == v || triangles[3 * t + 1] == v || triangles[3 * t + 2] == v;
+	};
+
+	std::vector<unsigned int> version(numberOfVertices, 0);
+	std::priority_queue<Collapse> collapses;
+	auto queue = [&](unsigned int from, unsigned int to) {
+		Quadric quadric = quadrics[from];
+		quadric += quadrics[to];
+		collapses.push({ quadric.evaluate(glm::dvec3(position(to))), from, to, version[from], version[to] });
+	};
+	for (unsigned int t = 0; t < numberOfTriangles; ++t) if (!removed[t]) {
+		for (unsigned int k = 0; k < 3; ++k) {
+			queue(triangles[3 * t + k], triangles[3 * t + (k + 1) % 3]);
+			queue(triangles[3 * t + (k + 1) % 3], triangles[3 * t + k]);
+		}
+	}
+
+	// A collapse is rejected if it flips any of the triangles that are moved.
+	auto flips = [&](unsigned int from, unsigned int to) {
+		for (unsigned int t : vertexTriangles[from]) {
+			if (removed[t] || !contains(t, from) || contains(t, to)) continue;
+			glm::vec3 p[3], q[3];
+			for (unsigned int k = 0; k < 3; ++k) {
+				p[k] = position(triangles[3 * t + k]);
+				q[k] = triangles[3 * t + k] == from ? position(to) : p[k];
+			}
+			if (glm::dot(glm::cross(p[1] - p[0], p[2] - p[0]), glm::cross(q[1] - q[0], q[2] - q[0])) <= 0) return true;
+		}
+		return false;
+	};
+
+	// Collapse until the number of triangles has been halved, and store the result as a level. The error of a level is
+	// the largest error of any collapse so far, i.e. an estimate of how far the level is from the surface of the mesh.
+	double error = 0;
+	unsigned int target = remaining / 2;
+	while (!collapses.empty() && mesh.levelsOfDetail.size() < MAX_LEVELS) {
+		const Collapse collapse = collapses.top();
+		collapses.pop();
+		const unsigned int from = collapse.from, to = collapse.to;
+		if (version[from] != collapse.fromVersion || version[to] != collapse.toVersion || flips(from, to)) continue;
+
+		error = std::max(error, std::sqrt(collapse.error));
+		for (unsigned int t : vertexTriangles[from]) {
+			if (removed[t] || !contains(t, from)) continue;
+			if (contains(t, to)) {
+				removed[t] = true;
+				--remaining;
+				continue;
+			}
+			for (unsigned int k = 0; k < 3; ++k) if (triangles[3 * t + k] == from) {
+				triangles[3 * t + k] = to;
+				corners[3 * t + k] = closestVertex(to, corners[3 * t + k]);
+			}
+			vertexTriangles[to].push_back(t);
+		}
+		std::vector<unsigned int>().swap(vertexTriangles[from]);
+		quadrics[to] += quadrics[from];
+		++version[from];
+		++version[to];
+
+		// The errors of the edges around the remaining vertex have changed.
+		auto & around = vertexTriangles[to];
+		around.erase(std::remove_if(around.begin(), around.end(), [&](unsigned int t) { return removed[t] || !contains(t, to); }), around.end());
+		for (unsigned int t : around) {
+			for (unsigned int k = 0; k < 3; ++k) {
+				const unsigned int v = triangles[3 * t + k];
+				if (v == to) continue;
+				queue(to, v);
+				queue(v, to);
+			}
+		}
+
+		if (remaining <= target) {
+			mesh.levelsOfDetail.emplace_back();
+			Mesh::LevelOfDetail & level = mesh.levelsOfDetail.back();
+			level.error = (float)error;
+			level.indices.reserve(3 * remaining);
+			for (unsigned int t = 0; t < numberOfTriangles; ++t) if (!removed[t]) {
+				level.indices.insert(level.indices.end(), &corners[3 * t], &corners[3 * t] + 3);
+			}
+			target = remaining / 2;
+			if (target < MIN_TRIANGLES) break;
+		}
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include "../Shape/Mesh.h"
+
+/// <summary> Simplifies imported meshes into levels of detail for the voxelization (see ObjLoader and Graphics::voxelize).
+/// A voxel only needs the surface to be accurate to within its size, so rasterizing every triangle of a detailed mesh into
+/// a coarse grid mostly generates redundant fragments. </summary>
+namespace MeshSimplifier {
+	/// <summary> Levels of detail are not generated below this number of triangles. </summary>
+	const unsigned int MIN_TRIANGLES = 128;
+
+	/// <summary> The maximum number of levels of detail per mesh, i.e. the coarsest has at least 1 / 2^MAX_LEVELS of the triangles. </summary>
+	const unsigned int MAX_LEVELS = 8;
+
+	/// <summary> Replaces the levels of detail of a mesh with a chain in which every level has about half the triangles of
+	/// the previous one. The levels are simplified by collapsing edges in the order of their quadric error (Garland and Heckbert,
+	/// "Surface Simplification Using Quadric Error Metrics", 1997). Vertices are only collapsed into other vertices, so the
+	/// levels use the vertices of the mesh, and vertices with the same position are collapsed together (i.e. normal seams
+	/// don't crack). Every corner keeps its vertex, or the one at its new position with the closest normal and texture
+	/// coordinate, so seams keep their attributes. Borders are preserved by constraint planes. </summary>
+	void generateLevelsOfDetail(Mesh & mesh);
+}
@@ -1,10 +1,18 @@
 #include "ObjLoader.h"
 
 #define __UTILITY_LOG_LOADING_TIME true
+#define __UTILITY_PARALLEL_OBJ_PARSER true // Parses using ObjParser instead of tinyobjloader.
+#define __UTILITY_VALIDATE_OBJ_PARSER false // Also parses using tinyobjloader, and reports where ObjParser's meshes differ.
+#define __UTILITY_OPTIMIZE_MESHES true // Welds and reorders the vertices and triangles of the meshes (see MeshOptimizer).
+#define __UTILITY_GENERATE_LEVELS_OF_DETAIL true // Simplifies the meshes for the voxelization (see MeshSimplifier).
 
 #include <fstream>
 #include <vector>
 #include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
 
 #if __UTILITY_LOG_LOADING_TIME
 #define GLEW_STATIC
@@ -15,9 +23,244 @@
 #include "../time/Time.h"
 #endif
 
+#if __UTILITY_VALIDATE_OBJ_PARSER
+#include <iostream>
+#endif
+
 #include "External/tiny_obj_loader.h"
 #include "../Shape/VertexData.h"
 #include "../Shape/Mesh.h"
+#include "MappedFile.h"
+#include "Directory.h"
+#include "ObjParser.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+const char * ObjLoader::CACHE_PATH = "Assets/Models/Cache/";
+
+namespace {
+	// Binary mesh cache: a header, followed by a MeshCacheEntry per mesh, followed by the vertex data and indices of every mesh.
+	// The indices of a mesh are followed by a LevelOfDetailEntry and the indices of every level of detail.
+	// The vertex data is stored as VertexData, i.e. it's copied to the meshes as is. Everything is 4 byte aligned.
+	const char MESH_CACHE_MAGIC[4] = { 'V', 'C', 'T', 'M' };
+	const uint32_t MESH_CACHE_VERSION = 4; // 2: The meshes are optimized. 3: Levels of detail. 4: Levels of detail keep seams.
+
+	struct MeshCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize; // sizeof(VertexData) when the cache was written.
+		uint32_t numberOfMeshes;
+		uint64_t sourceSize, sourceTime; // Size and modification time of the .obj-file.
+	};
+
+	struct MeshCacheEntry {
+		uint32_t numberOfVertices, numberOfIndices, numberOfLevelsOfDetail;
+	};
+
+	struct LevelOfDetailEntry {
+		uint32_t numberOfIndices;
+		float error;
+	};
+
+	/// <summary> 64 bit FNV-1a of the path, which names the cache file. </summary>
+	std::string getCachePath(const std::string & path) {
+		uint64_t h = 14695981039346656037ull;
+		for (unsigned char c : path) { h = (h ^ c) * 1099511628211ull; }
+		char name[17];
+		std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)h);
+		return ObjLoader::CACHE_PATH + std::string(name) + ".mesh";
+	}
+
+	/// <summary> Returns a header that describes the cache of an .obj-file. The magic is left empty if the file doesn't exist. </summary>
+	MeshCacheHeader getExpectedHeader(const std::string & path) {
+		MeshCacheHeader header = {};
+		struct stat source;
+		if (stat(path.c_str(), &source) != 0) return header;
+		std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+		header.version = MESH_CACHE_VERSION;
+		header.vertexSize = sizeof(VertexData);
+		header.sourceSize = (uint64_t)source.st_size;
+		header.sourceTime = (uint64_t)source.st_mtime;
+		return header;
+	}
+
+	/// <summary> Loads the meshes of an .obj-file from its cache. Returns nullptr if there is no cache, or if it's outdated. </summary>
+	Shape * loadMeshCache(const std::string & path, const MeshCacheHeader & expected) {
+		MappedFile file(getCachePath(path));
+		if (!file.isMapped() || file.size() < sizeof(MeshCacheHeader)) return nullptr;
+		MeshCacheHeader header;
+		std::memcpy(&header, file.data(), sizeof(header));
+		if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version ||
+			header.vertexSize != expected.vertexSize || header.sourceSize != expected.sourceSize || header.sourceTime != expected.sourceTime) {
+			return nullptr;
+		}
+
+		// Every read is bounds checked, so that a truncated cache is rejected rather than read past its end.
+		const unsigned char * data = file.data() + sizeof(header), * end = file.data() + file.size();
+		bool truncated = false;
+		auto read = [&](size_t size) -> const unsigned char * {
+			truncated = truncated || (size_t)(end - data) < size;
+			if (truncated) return nullptr;
+			data += size;
+			return data - size;
+		};
+		const MeshCacheEntry * entries = (const MeshCacheEntry *)read(header.numberOfMeshes * sizeof(MeshCacheEntry));
+		if (entries == nullptr) return nullptr;
+
+		Shape * result = new Shape();
+		result->meshes.resize(header.numberOfMeshes);
+		for (uint32_t i = 0; i < header.numberOfMeshes; ++i) {
+			Mesh & mesh = result->meshes[i];
+			const VertexData * vertexData = (const VertexData *)read(entries[i].numberOfVertices * sizeof(VertexData));
+			const unsigned int * indices = (const unsigned int *)read(entries[i].numberOfIndices * sizeof(unsigned int));
+			if (vertexData == nullptr || indices == nullptr) break;
+			mesh.vertexData.assign(vertexData, vertexData + entries[i].numberOfVertices);
+			mesh.indices.assign(indices, indices + entries[i].numberOfIndices);
+			mesh.levelsOfDetail.resize(entries[i].numberOfLevelsOfDetail);
+			for (auto & level : mesh.levelsOfDetail) {
+				const LevelOfDetailEntry * entry = (const LevelOfDetailEntry *)read(sizeof(LevelOfDetailEntry));
+				indices = entry != nullptr ? (const unsigned int *)read(entry->numberOfIndices * sizeof(unsigned int)) : nullptr;
+				if (indices == nullptr) break;
+				level.indices.assign(indices, indices + entry->numberOfIndices);
+				level.error = entry->error;
+			}
+		}
+		if (truncated || data != end) {
+			delete result;
+			return nullptr;
+		}
+		return result;
+	}
+
+	/// <summary> Writes the cache of an .obj-file. Does nothing if the cache folder can't be created. </summary>
+	void storeMeshCache(const std::string & path, MeshCacheHeader header, const Shape & shape) {
+		if (!Directory::create(ObjLoader::CACHE_PATH)) {
+#if __UTILITY_LOG_LOADING_TIME
+			std::cerr << " - Could not create the mesh cache folder '" << ObjLoader::CACHE_PATH << "', so '" << path << "' is not cached." << std::endl;
+#endif
+			return;
+		}
+		std::ofstream file(getCachePath(path), std::ios::out | std::ios::binary);
+		if (!file.is_open()) return;
+		header.numberOfMeshes = shape.meshes.size();
+		file.write((const char *)&header, sizeof(header));
+		for (const auto & mesh : shape.meshes) {
+			const MeshCacheEntry entry = { (uint32_t)mesh.vertexData.size(), (uint32_t)mesh.indices.size(), (uint32_t)mesh.levelsOfDetail.size() };
+			file.write((const char *)&entry, sizeof(entry));
+		}
+		for (const auto & mesh : shape.meshes) {
+			file.write((const char *)mesh.vertexData.data(), mesh.vertexData.size() * sizeof(VertexData));
+			file.write((const char *)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+			for (const auto & level : mesh.levelsOfDetail) {
+				const LevelOfDetailEntry entry = { (uint32_t)level.indices.size(), level.error };
+				file.write((const char *)&entry, sizeof(entry));
+				file.write((const char *)level.indices.data(), level.indices.size() * sizeof(unsigned int));
+			}
+		}
+	}
+
+#if !__UTILITY_PARALLEL_OBJ_PARSER || __UTILITY_VALIDATE_OBJ_PARSER
+	/// <summary> Parses an .obj-file using tinyobjloader, and adds its meshes to a shape. </summary>
+	bool parseWithTinyObj(const std::string & path, Shape & result, std::string & err) {
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		if (!tinyobj::LoadObj(shapes, materials, err, path.c_str()) || shapes.size() == 0) return false;
+
+		// Load all shapes. The meshes are constructed in place, since copying a mesh copies its data.
+		result.meshes.reserve(shapes.size());
+		for (const auto & shape : shapes) {
+
+			// Create a new mesh.
+			result.meshes.emplace_back();
+			Mesh & newMesh = result.meshes.back();
+			auto & vertexData = newMesh.vertexData;
+			auto & indices = newMesh.indices;
+
+			indices.reserve(shape.mesh.indices.size());
+
+			// Push back all indices.
+			for (const auto index : shape.mesh.indices) {
+				indices.push_back(index);
+			}
+
+			vertexData.reserve(shape.mesh.positions.size());
+
+			// Positions.
+			for (unsigned int i = 0, j = 0; i < shape.mesh.positions.size(); i += 3, ++j) {
+				if (j >= vertexData.size()) {
+					vertexData.push_back(VertexData());
+				}
+				vertexData[j].position.x = shape.mesh.positions[i + 0];
+				vertexData[j].position.y = shape.mesh.positions[i + 1];
+				vertexData[j].position.z = shape.mesh.positions[i + 2];
+			}
+
+			// Normals.
+			for (unsigned int i = 0, j = 0; i < shape.mesh.normals.size(); i += 3, ++j) {
+				if (j >= vertexData.size()) {
+					vertexData.push_back(VertexData());
+				}
+				vertexData[j].normal.x = shape.mesh.normals[i + 0];
+				vertexData[j].normal.y = shape.mesh.normals[i + 1];
+				vertexData[j].normal.z = shape.mesh.normals[i + 2];
+			}
+
+			// Texture coordinates.
+			for (unsigned int i = 0, j = 0; i < shape.mesh.texcoords.size(); i += 2, ++j) {
+				if (j >= vertexData.size()) {
+					vertexData.push_back(VertexData());
+				}
+				vertexData[j].texCoord.x = shape.mesh.texcoords[i + 0];
+				vertexData[j].texCoord.y = shape.mesh.texcoords[i + 1];
+			}
+		}
+		return true;
+	}
+#endif
+
+#if __UTILITY_VALIDATE_OBJ_PARSER
+	/// <summary> Parses an .obj-file using tinyobjloader as well, and reports where the meshes of ObjParser differ.
+	/// The meshes should be identical, since ObjParser numbers the vertices and triangulates the faces like tinyobjloader. </summary>
+	void validateObjParser(const std::string & path, const Shape & parsed) {
+		Shape reference;
+		std::string err;
+		if (!parseWithTinyObj(path, reference, err)) {
+			std::cerr << " - Could not validate ObjParser, since tinyobjloader failed to load '" << path << "'." << std::endl;
+			return;
+		}
+		if (reference.meshes.size() != parsed.meshes.size()) {
+			std::cerr << " - ObjParser found " << parsed.meshes.size() << " meshes in '" << path << "', but tinyobjloader found " << reference.meshes.size() << "." << std::endl;
+			return;
+		}
+
+		// Vertices are compared bitwise, i.e. the numbers have to be parsed to the same floats.
+		size_t vertices = 0, indices = 0, differentVertices = 0, differentIndices = 0;
+		for (size_t i = 0; i < reference.meshes.size(); ++i) {
+			const Mesh & a = reference.meshes[i], & b = parsed.meshes[i];
+			vertices += a.vertexData.size();
+			indices += a.indices.size();
+			differentVertices += std::max(a.vertexData.size(), b.vertexData.size()) - std::min(a.vertexData.size(), b.vertexData.size());
+			differentIndices += std::max(a.indices.size(), b.indices.size()) - std::min(a.indices.size(), b.indices.size());
+			for (size_t j = 0; j < std::min(a.vertexData.size(), b.vertexData.size()); ++j) {
+				const VertexData & x = a.vertexData[j], & y = b.vertexData[j];
+				const bool same = std::memcmp(&x.position, &y.position, sizeof(x.position)) == 0
+					&& std::memcmp(&x.normal, &y.normal, sizeof(x.normal)) == 0 && std::memcmp(&x.texCoord, &y.texCoord, sizeof(x.texCoord)) == 0;
+				if (!same) ++differentVertices;
+			}
+			for (size_t j = 0; j < std::min(a.indices.size(), b.indices.size()); ++j) {
+				if (a.indices[j] != b.indices[j]) ++differentIndices;
+			}
+		}
+		if (differentVertices == 0 && differentIndices == 0) {
+			std::cout << " - ObjParser matches tinyobjloader for '" << path << "' (" << vertices << " vertices, " << indices << " indices)." << std::endl;
+		}
+		else {
+			std::cerr << " - ObjParser differs from tinyobjloader for '" << path << "' in " << differentVertices << " of " << vertices
+				<< " vertices and " << differentIndices << " of " << indices << " indices." << std::endl;
+		}
+	}
+#endif
+}
 
 Shape * ObjLoader::loadObjFile(const std::string path) {
 #if __UTILITY_LOG_LOADING_TIME
@@ -26,15 +269,49 @@ Shape * ObjLoader::loadObjFile(const std::string path) {
 	std::cout << "Loading obj '" << path << "'..." << std::endl;
 #endif
 
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
+	// Use the cache if the .obj-file hasn't changed since it was written.
+	const MeshCacheHeader cacheHeader = getExpectedHeader(path);
+	if (cacheHeader.version != 0) {
+		Shape * cached = loadMeshCache(path, cacheHeader);
+		if (cached != nullptr) {
+#if __UTILITY_LOG_LOADING_TIME
+			took = glfwGetTime() - logTimestamp;
+			std::cout << std::setprecision(4) << " - Loading '" << path << "' took " << took << " seconds (from the mesh cache)." << std::endl;
+#endif
+			return cached;
+		}
+	}
+
+#if __UTILITY_PARALLEL_OBJ_PARSER
 	Shape * result = new Shape();
+	std::string err = "The file could not be opened.";
+	MappedFile file(path);
+	if (!file.isMapped() || !ObjParser::parse((const char *)file.data(), file.size(), *result, err)) {
+#if __UTILITY_LOG_LOADING_TIME
+		std::cerr << "Failed to load object with path '" << path << "'. Error message:" << std::endl << err << std::endl;
+#endif
+		delete result;
+		return nullptr;
+	}
 
+#if __UTILITY_LOG_LOADING_TIME
+	took = glfwGetTime() - logTimestamp;
+	std::cout << std::setprecision(4) << " - Parsing '" << path << "' took " << took << " seconds (by ObjParser)." << std::endl;
+#endif
+#if __UTILITY_VALIDATE_OBJ_PARSER
+	validateObjParser(path, *result);
+#endif
+#if __UTILITY_LOG_LOADING_TIME
+	logTimestamp = glfwGetTime();
+#endif
+#else
+	Shape * result = new Shape();
 	std::string err;
-	if (!tinyobj::LoadObj(shapes, materials, err, path.c_str()) || shapes.size() == 0) {
+	if (!parseWithTinyObj(path, *result, err)) {
 #if __UTILITY_LOG_LOADING_TIME
 		std::cerr << "Failed to load object with path '" << path << "'. Error message:" << std::endl << err << std::endl;
 #endif
+		delete result;
 		return nullptr;
 	}
 
@@ -43,55 +320,18 @@ Shape * ObjLoader::loadObjFile(const std::string path) {
 	std::cout << std::setprecision(4) << " - Parsing '" << path << "' took " << took << " seconds (by tinyobjloader)." << std::endl;
 	logTimestamp = glfwGetTime();
 #endif
+#endif
 
-	// Load all shapes.
-	for (const auto & shape : shapes) {
-
-		// Create a new mesh.
-		Mesh newMesh;
-		auto & vertexData = newMesh.vertexData;
-		auto & indices = newMesh.indices;
-
-		indices.reserve(shape.mesh.indices.size());
-
-		// Push back all indices.
-		for (const auto index : shape.mesh.indices) {
-			indices.push_back(index);
-		}
-
-		vertexData.reserve(shape.mesh.positions.size());
-
-		// Positions.
-		for (unsigned int i = 0, j = 0; i < shape.mesh.positions.size(); i += 3, ++j) {
-			if (j >= vertexData.size()) {
-				vertexData.push_back(VertexData());
-			}
-			vertexData[j].position.x = shape.mesh.positions[i + 0];
-			vertexData[j].position.y = shape.mesh.positions[i + 1];
-			vertexData[j].position.z = shape.mesh.positions[i + 2];
-		}
-
-		// Normals.
-		for (unsigned int i = 0, j = 0; i < shape.mesh.normals.size(); i += 3, ++j) {
-			if (j >= vertexData.size()) {
-				vertexData.push_back(VertexData());
-			}
-			vertexData[j].normal.x = shape.mesh.normals[i + 0];
-			vertexData[j].normal.y = shape.mesh.normals[i + 1];
-			vertexData[j].normal.z = shape.mesh.normals[i + 2];
-		}
+#if __UTILITY_OPTIMIZE_MESHES
+	for (auto & mesh : result->meshes) MeshOptimizer::optimize(mesh);
+#endif
 
-		// Texture coordinates.
-		for (unsigned int i = 0, j = 0; i < shape.mesh.texcoords.size(); i += 2, ++j) {
-			if (j >= vertexData.size()) {
-				vertexData.push_back(VertexData());
-			}
-			vertexData[j].texCoord.x = shape.mesh.texcoords[i + 0];
-			vertexData[j].texCoord.y = shape.mesh.texcoords[i + 1];
-		}
+	// The levels of detail refer to the vertices, so they are generated after the vertices have been reordered.
+#if __UTILITY_GENERATE_LEVELS_OF_DETAIL
+	for (auto & mesh : result->meshes) MeshSimplifier::generateLevelsOfDetail(mesh);
+#endif
 
-		result->meshes.push_back(newMesh);
-	}
+	if (cacheHeader.version != 0) storeMeshCache(path, cacheHeader, *result);
 
 #if __UTILITY_LOG_LOADING_TIME
 	took = glfwGetTime() - logTimestamp;
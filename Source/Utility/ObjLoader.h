@@ -1,6 +1,10 @@
 #pragma once
 #include "../Shape/Shape.h"
 namespace ObjLoader {
-	/// <summary> Loads an .obj-file into a Shape object. </summary>
+	/// <summary> The folder that binary copies of loaded .obj-files are stored in (see loadObjFile). Created when the first file is cached. </summary>
+	extern const char * CACHE_PATH;
+
+	/// <summary> Loads an .obj-file into a Shape object. The meshes are cached in a binary file the first time, and are
+	/// copied straight from a memory mapping of that file as long as the .obj-file is unchanged. </summary>
 	Shape * loadObjFile(const std::string path = "Assets\\Models\\teapot.obj");
 }
\ No newline at end of file
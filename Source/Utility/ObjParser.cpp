@@ -0,0 +1,277 @@
+#include "ObjParser.h"
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+	// The index of a texture coordinate or normal that a face corner doesn't have. Relative indices that point before
+	// the start of the file become negative, so this has to be a value that they can't take.
+	const int MISSING = std::numeric_limits<int>::min();
+	const size_t MIN_CHUNK_SIZE = 1 << 18; // Smaller files aren't worth starting threads for.
+
+	/// <summary> The position, texture coordinate and normal indices of a face corner. </summary>
+	struct Corner {
+		int v, vt, vn;
+	};
+
+	/// <summary> What a thread has parsed. Indices are global (i.e. 0 based from the start of the file), except for
+	/// relative (negative) indices, which are stored relative to the chunk and listed in relativeIndices. </summary>
+	struct Chunk {
+		const char * begin, * end;
+		std::vector<float> positions, texCoords, normals;
+		std::vector<Corner> corners; // The corners of all faces.
+		std::vector<unsigned int> faceEnds; // The end of every face in corners.
+		std::vector<size_t> groupStarts; // The number of faces parsed before every g- and o-line.
+		std::vector<std::pair<size_t, int>> relativeIndices; // The corner and the attribute (0 == v, 1 == vt, 2 == vn).
+		const char * error = nullptr; // Why the chunk is malformed, if it is.
+	};
+
+	inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+	inline bool isDigit(char c) { return (unsigned int)(c - '0') < 10u; }
+
+	inline const char * skipSpace(const char * s, const char * end) {
+		while (s < end && isSpace(*s)) ++s;
+		return s;
+	}
+
+	/// <summary> Parses an integer like atoi does, i.e. an optional sign followed by digits. </summary>
+	inline const char * parseInt(const char * s, const char * end, int & value) {
+		const bool negative = s < end && *s == '-';
+		if (s < end && (*s == '-' || *s == '+')) ++s;
+		int result = 0;
+		for (; s < end && isDigit(*s); ++s) result = 10 * result + (*s - '0');
+		value = negative ? -result : result;
+		return s;
+	}
+
+	/// <summary> Parses a decimal floating point number (with an optional exponent). Yields 0 if there are no digits. </summary>
+	inline const char * parseFloat(const char * s, const char * end, float & value) {
+		static const double POWERS_OF_TEN[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+		s = skipSpace(s, end);
+		const bool negative = s < end && *s == '-';
+		if (s < end && (*s == '-' || *s == '+')) ++s;
+
+		// The digits are accumulated into an integer, so that the value is rounded once (when scaled by the exponent).
+		uint64_t mantissa = 0;
+		int exponent = 0, digits = 0;
+		for (; s < end && isDigit(*s); ++s, ++digits) {
+			if (mantissa < 100000000000000000ull) mantissa = 10 * mantissa + (*s - '0');
+			else ++exponent;
+		}
+		if (s < end && *s == '.') {
+			for (++s; s < end && isDigit(*s); ++s, ++digits) {
+				if (mantissa < 100000000000000000ull) { mantissa = 10 * mantissa + (*s - '0'); --exponent; }
+			}
+		}
+		if (digits > 0 && s < end && (*s == 'e' || *s == 'E')) {
+			int e;
+			s = parseInt(s + 1, end, e);
+			exponent += e;
+		}
+
+		double result = (double)mantissa;
+		if (exponent >= 0 && exponent <= 22) result *= POWERS_OF_TEN[exponent];
+		else if (exponent < 0 && exponent >= -22) result /= POWERS_OF_TEN[-exponent];
+		else result *= std::pow(10.0, exponent);
+		value = (float)(negative ? -result : result);
+
+		// Skip anything that follows the number, like tinyobjloader does.
+		while (s < end && !isSpace(*s)) ++s;
+		return s;
+	}
+
+	/// <summary> Parses a face corner: v, v/vt, v//vn or v/vt/vn. Indices are made 0 based. Indices can't be 0, since
+	/// positive indices are 1 based and negative ones relative. Whether indices are in range is checked once all vertices are known. </summary>
+	inline const char * parseCorner(const char * s, const char * end, Chunk & chunk, const int counts[3]) {
+		int indices[3] = { 0, MISSING, MISSING };
+		bool present[3] = { true, false, false };
+		s = parseInt(s, end, indices[0]);
+		if (s < end && *s == '/') {
+			++s;
+			if (s < end && *s != '/' && !isSpace(*s)) { s = parseInt(s, end, indices[1]); present[1] = true; }
+			if (s < end && *s == '/') { s = parseInt(s + 1, end, indices[2]); present[2] = true; }
+		}
+		for (int i = 0; i < 3; ++i) {
+			if (!present[i]) continue;
+			if (indices[i] == 0) chunk.error = "A face has an index of 0.";
+			else if (indices[i] > 0) indices[i] -= 1;
+			else if (indices[i] < 0) {
+				// Relative to the vertices parsed so far, i.e. to those before this chunk as well.
+				indices[i] += counts[i];
+				chunk.relativeIndices.emplace_back(chunk.corners.size(), i);
+			}
+		}
+		chunk.corners.push_back({ indices[0], indices[1], indices[2] });
+		while (s < end && !isSpace(*s)) ++s;
+		return s;
+	}
+
+	void parseChunk(Chunk & chunk) {
+		for (const char * line = chunk.begin; line < chunk.end;) {
+			const char * lineEnd = std::find(line, chunk.end, '\n');
+			const char * next = lineEnd < chunk.end ? lineEnd + 1 : lineEnd;
+			if (lineEnd > line && lineEnd[-1] == '\r') --lineEnd;
+			const char * s = skipSpace(line, lineEnd);
+			line = next;
+			if (lineEnd - s < 2) continue;
+
+			if (s[0] == 'v' && isSpace(s[1])) {
+				float x, y, z;
+				s = parseFloat(s + 2, lineEnd, x);
+				s = parseFloat(s, lineEnd, y);
+				parseFloat(s, lineEnd, z);
+				chunk.positions.insert(chunk.positions.end(), { x, y, z });
+			}
+			else if (s[0] == 'v' && s[1] == 'n' && lineEnd - s > 2 && isSpace(s[2])) {
+				float x, y, z;
+				s = parseFloat(s + 3, lineEnd, x);
+				s = parseFloat(s, lineEnd, y);
+				parseFloat(s, lineEnd, z);
+				chunk.normals.insert(chunk.normals.end(), { x, y, z });
+			}
+			else if (s[0] == 'v' && s[1] == 't' && lineEnd - s > 2 && isSpace(s[2])) {
+				float x, y;
+				s = parseFloat(s + 3, lineEnd, x);
+				parseFloat(s, lineEnd, y);
+				chunk.texCoords.insert(chunk.texCoords.end(), { x, y });
+			}
+			else if (s[0] == 'f' && isSpace(s[1])) {
+				const int counts[3] = { int(chunk.positions.size() / 3), int(chunk.texCoords.size() / 2), int(chunk.normals.size() / 3) };
+				const size_t faceBegin = chunk.corners.size();
+				for (s = skipSpace(s + 2, lineEnd); s < lineEnd; s = skipSpace(s, lineEnd)) {
+					s = parseCorner(s, lineEnd, chunk, counts);
+				}
+				if (chunk.corners.size() - faceBegin < 3) chunk.error = "A face has less than three vertices.";
+				if (chunk.error != nullptr) return;
+				chunk.faceEnds.push_back(chunk.corners.size());
+			}
+			else if ((s[0] == 'g' || s[0] == 'o') && isSpace(s[1])) {
+				chunk.groupStarts.push_back(chunk.faceEnds.size());
+			}
+		}
+	}
+
+	/// <summary> Splits [begin, end) into (at most) numberOfChunks chunks that start at the beginning of a line. </summary>
+	std::vector<Chunk> split(const char * begin, const char * end, unsigned int numberOfChunks) {
+		std::vector<Chunk> chunks;
+		const size_t size = end - begin;
+		const char * chunkBegin = begin;
+		for (unsigned int i = 1; i <= numberOfChunks && chunkBegin < end; ++i) {
+			const char * chunkEnd = i == numberOfChunks ? end : std::max(chunkBegin, begin + size / numberOfChunks * i);
+			chunkEnd = std::find(chunkEnd, end, '\n');
+			if (chunkEnd < end) ++chunkEnd;
+			chunks.emplace_back();
+			chunks.back().begin = chunkBegin;
+			chunks.back().end = chunkEnd;
+			chunkBegin = chunkEnd;
+		}
+		return chunks;
+	}
+}
+
+bool ObjParser::parse(const char * data, size_t size, Shape & shape, std::string & error, unsigned int numberOfThreads)
+{
+	// Parse the chunks in parallel.
+	unsigned int threads = numberOfThreads;
+	if (threads == 0) threads = std::min<unsigned int>(std::thread::hardware_concurrency(), size / MIN_CHUNK_SIZE + 1);
+	threads = std::max(threads, 1u);
+	std::vector<Chunk> chunks = split(data, data + size, threads);
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < chunks.size(); ++i) workers.emplace_back(parseChunk, std::ref(chunks[i]));
+	if (!chunks.empty()) parseChunk(chunks[0]);
+	for (auto & worker : workers) worker.join();
+
+	// Concatenate the chunks. The relative indices of a chunk are offset by what the chunks before it have parsed.
+	std::vector<float> positions, texCoords, normals;
+	std::vector<Corner> corners;
+	std::vector<size_t> faceEnds, groupStarts;
+	for (auto & chunk : chunks) {
+		if (chunk.error != nullptr) {
+			error = chunk.error;
+			return false;
+		}
+		const int offsets[3] = { int(positions.size() / 3), int(texCoords.size() / 2), int(normals.size() / 3) };
+		for (const auto & relative : chunk.relativeIndices) {
+			Corner & corner = chunk.corners[relative.first];
+			(relative.second == 0 ? corner.v : relative.second == 1 ? corner.vt : corner.vn) += offsets[relative.second];
+		}
+		for (size_t group : chunk.groupStarts) groupStarts.push_back(faceEnds.size() + group);
+		for (unsigned int faceEnd : chunk.faceEnds) faceEnds.push_back(corners.size() + faceEnd);
+		positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+		texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+		corners.insert(corners.end(), chunk.corners.begin(), chunk.corners.end());
+		chunk = Chunk(); // Frees the chunk, since large files would otherwise be held twice.
+	}
+	groupStarts.push_back(faceEnds.size());
+
+	// Vertices are deduplicated per group. The vertices that use a position are linked, so a lookup only visits those.
+	const int numberOfPositions = positions.size() / 3, numberOfTexCoords = texCoords.size() / 2, numberOfNormals = normals.size() / 3;
+	std::vector<int> firstVertex(numberOfPositions, -1), nextVertex;
+	std::vector<Corner> vertexCorners;
+	shape.meshes.reserve(shape.meshes.size() + groupStarts.size()); // Copying a mesh copies its data.
+	for (size_t group = 0, faceBegin = 0; group < groupStarts.size(); faceBegin = groupStarts[group++]) {
+		const size_t faceEnd = groupStarts[group];
+		if (faceEnd == faceBegin) continue;
+
+		shape.meshes.emplace_back();
+		Mesh & mesh = shape.meshes.back();
+		for (const Corner & corner : vertexCorners) firstVertex[corner.v] = -1;
+		vertexCorners.clear();
+		nextVertex.clear();
+
+		auto getVertex = [&](const Corner & corner) -> unsigned int {
+			for (int vertex = firstVertex[corner.v]; vertex >= 0; vertex = nextVertex[vertex]) {
+				if (vertexCorners[vertex].vt == corner.vt && vertexCorners[vertex].vn == corner.vn) return vertex;
+			}
+			nextVertex.push_back(firstVertex[corner.v]);
+			firstVertex[corner.v] = vertexCorners.size();
+			vertexCorners.push_back(corner);
+			return vertexCorners.size() - 1;
+		};
+
+		// Polygons are triangulated as fans.
+		for (size_t face = faceBegin; face < faceEnd; ++face) {
+			const size_t begin = face > 0 ? faceEnds[face - 1] : 0;
+			for (size_t k = begin + 2; k < faceEnds[face]; ++k) {
+				for (size_t c : { begin, k - 1, k }) {
+					if (corners[c].v < 0 || corners[c].v >= numberOfPositions) {
+						error = "A face refers to a vertex that doesn't exist.";
+						return false;
+					}
+					if (corners[c].vt != MISSING && (corners[c].vt < 0 || corners[c].vt >= numberOfTexCoords)) {
+						error = "A face refers to a texture coordinate that doesn't exist.";
+						return false;
+					}
+					if (corners[c].vn != MISSING && (corners[c].vn < 0 || corners[c].vn >= numberOfNormals)) {
+						error = "A face refers to a normal that doesn't exist.";
+						return false;
+					}
+					mesh.indices.push_back(getVertex(corners[c]));
+				}
+			}
+		}
+
+		mesh.vertexData.resize(vertexCorners.size());
+		for (size_t i = 0; i < vertexCorners.size(); ++i) {
+			const Corner & corner = vertexCorners[i];
+			VertexData & vertex = mesh.vertexData[i];
+			vertex.position = glm::vec3(positions[3 * corner.v], positions[3 * corner.v + 1], positions[3 * corner.v + 2]);
+			if (corner.vt != MISSING) vertex.texCoord = glm::vec2(texCoords[2 * corner.vt], texCoords[2 * corner.vt + 1]);
+			if (corner.vn != MISSING) vertex.normal = glm::vec3(normals[3 * corner.vn], normals[3 * corner.vn + 1], normals[3 * corner.vn + 2]);
+		}
+	}
+
+	if (shape.meshes.empty()) {
+		error = "The file doesn't have any faces.";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+#include "../Shape/Shape.h"
+
+/// <summary> A multithreaded .obj-parser. The file is split into line aligned chunks that are parsed in parallel, and the
+/// faces of every group (or object) are then turned into a mesh, with one vertex per unique combination of position,
+/// texture coordinate and normal. Vertices are numbered and faces are triangulated like tinyobjloader does.
+/// Only geometry is read, i.e. materials and tags are ignored. </summary>
+namespace ObjParser {
+	/// <summary> Parses the .obj-file in [data, data + size), and adds its meshes to a shape. Uses one thread per
+	/// hardware thread if numberOfThreads is 0. Returns false (and the reason in error) if the file is malformed. </summary>
+	bool parse(const char * data, size_t size, Shape & shape, std::string & error, unsigned int numberOfThreads = 0);
+}